@@ -2,21 +2,30 @@
 
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
-layout (location = 1) in vec3 vertexColor;
 
-uniform mat4 MVP;
+// shared by every program, uploaded once per frame
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// per object : position (x, y) and Z rotation as (cos, sin),
+// applied after scaling the mesh by objectScale
+uniform vec4 objectTransform;
+uniform vec2 objectScale;
+// the whole object is drawn in one colour
+uniform vec3 objectColor;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec2 p = vertexPosition.xy * objectScale;
+    vec2 r = vec2(p.x*objectTransform.z - p.y*objectTransform.w,
+                  p.x*objectTransform.w + p.y*objectTransform.z);
 
-    // The color of each vertex will be interpolated
-    // to produce the color of each fragment
-    fragColor = vertexColor;
+    fragColor = objectColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space : VP * model position
+    gl_Position = VP * vec4(r + objectTransform.xy, vertexPosition.z, 1);
 }
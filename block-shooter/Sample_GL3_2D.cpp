@@ -3,253 +3,767 @@
 #include <fstream>
 #include <vector>
 #include<unistd.h>
+#include <sys/stat.h>
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <GL/freeglut.h>
-#include<ao/ao.h>
-#include<mpg123.h>
-#define BITS 8
 #include<pthread.h>
 #include<bits/stdc++.h>
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "game.h"
+#include "replay.h"
+#include "profiler.h"
+#include "audio.h"
+#include "level.h"
+#include "shader_cache.h"
+#include "asset_watch.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+#include "particles.h"
+#include "hud.h"
+#include "offscreen.h"
+#include "files.h"
 
 using namespace std;
 
-struct VAO {
-	GLuint VertexArrayID;
-	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+/* A shape : a range of the shared mesh buffer. Meshes carry no colour,
+   it is given when drawing, so one mesh serves every object of its shape */
+struct Mesh {
+	GLint First;       // first vertex in the mesh buffer
+	int NumVertices;
 
 	GLenum PrimitiveMode;
 	GLenum FillMode;
-	int NumVertices;
 };
-typedef struct VAO VAO;
+typedef struct Mesh Mesh;
+
+/* One vertex of the mesh buffer */
+struct MeshVertex {
+	GLfloat x, y, z;
+};
 
 struct GLMatrices {
 	glm::mat4 projection;
-	glm::mat4 model;
 	glm::mat4 view;
-	GLuint MatrixID;
 } Matrices;
 
 GLuint programID;
+// uniforms of programID, set per object
+GLuint TransformID, ScaleID, ColorID;
 
-/* Function to load Shaders - Use it as it is */
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
+/* The view-projection matrix lives in one uniform buffer, bound to the
+   "Camera" block of every program, so it is uploaded once per view rather
+   than once per object or per program */
+#define CAMERA_BINDING 0
+GLuint cameraBuffer;
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+void createCamera ()
+{
+	glGenBuffers (1, &cameraBuffer);
+	glBindBuffer (GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferData (GL_UNIFORM_BUFFER, sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase (GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer);
+}
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open())
-	{
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+/* Connect the "Camera" block of 'program' to the shared buffer */
+void useCamera (GLuint program)
+{
+	glUniformBlockBinding (program, glGetUniformBlockIndex(program, "Camera"), CAMERA_BINDING);
+}
+
+void setCamera (const glm::mat4& VP)
+{
+	glBindBuffer (GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferSubData (GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), &VP[0][0]);
+}
+
+/* Every object is at most rotated about the Z axis and moved in the XY
+   plane, which the vertex shader applies from a vec4 (x, y, cos, sin).
+   The mesh is turned by 'degrees' about its point (pivot_x, pivot_y),
+   which then lands on (x, y) */
+glm::vec4 meshTransform (float x, float y, float degrees, float pivot_x=0, float pivot_y=0)
+{
+	float a = degrees*M_PI/180.0f, c = cos(a), s = sin(a);
+	return glm::vec4(x - (c*pivot_x - s*pivot_y), y - (s*pivot_x + c*pivot_y), c, s);
+}
+
+/* The last value set of the GL state that changes between draws, so that
+   setting it again costs nothing. All drawing goes through these setters;
+   call invalidateGLState() after changing any of it with GL directly.
+   Only programID has the colour and scale uniforms, and uniforms belong
+   to their program, so the cached values stay valid across program
+   switches */
+struct GLStateCache {
+	GLuint Program;
+	GLuint VertexArray;
+	GLenum FillMode;
+	GLfloat Color[3];
+	GLfloat Scale[2];
+} glState;
+
+void invalidateGLState ()
+{
+	glState.Program = ~0u;
+	glState.VertexArray = ~0u;
+	glState.FillMode = GL_NONE;
+	glState.Color[0] = -1; // no colour has a negative channel
+	glState.Scale[0] = 0;  // nor would anyone draw at scale 0
+}
+
+void useProgram (GLuint program)
+{
+	if (glState.Program != program) {
+		glUseProgram (program);
+		glState.Program = program;
+	}
+}
+
+void bindVertexArray (GLuint vao)
+{
+	if (glState.VertexArray != vao) {
+		glBindVertexArray (vao);
+		glState.VertexArray = vao;
+	}
+}
+
+void setFillMode (GLenum fill_mode)
+{
+	if (glState.FillMode != fill_mode) {
+		glPolygonMode (GL_FRONT_AND_BACK, fill_mode);
+		glState.FillMode = fill_mode;
+	}
+}
+
+void setColor (const GLfloat* colour)
+{
+	if (memcmp(glState.Color, colour, sizeof glState.Color)) {
+		glUniform3fv(ColorID, 1, colour);
+		memcpy(glState.Color, colour, sizeof glState.Color);
+	}
+}
+
+void setScale (const GLfloat* scale)
+{
+	if (memcmp(glState.Scale, scale, sizeof glState.Scale)) {
+		glUniform2fv(ScaleID, 1, scale);
+		memcpy(glState.Scale, scale, sizeof glState.Scale);
 	}
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+/* Every static mesh is packed into a single vertex buffer behind a single
+   VAO : meshes are appended to meshVertices at startup, uploaded once by
+   uploadMeshes(), and a frame binds the VAO once for all of them */
+std::vector<MeshVertex> meshVertices;
+GLuint meshVertexArrayID, meshVertexBuffer;
+
+/* Append a mesh to the shared buffer and return its range */
+struct Mesh* addMesh (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, GLenum fill_mode=GL_FILL)
+{
+	struct Mesh* mesh = new struct Mesh;
+	mesh->PrimitiveMode = primitive_mode;
+	mesh->First = meshVertices.size();
+	mesh->NumVertices = numVertices;
+	mesh->FillMode = fill_mode;
+
+	for (int i=0; i<numVertices; i++) {
+		MeshVertex v = { vertex_buffer_data[3*i], vertex_buffer_data[3*i + 1], vertex_buffer_data[3*i + 2] };
+		meshVertices.push_back(v);
 	}
+	return mesh;
+}
+
+/* Copy every added mesh to the GPU, after the last addMesh() */
+void uploadMeshes ()
+{
+	glGenVertexArrays(1, &meshVertexArrayID);
+	glGenBuffers (1, &meshVertexBuffer);
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> VertexShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &VertexShaderErrorMessage[0]);
-
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
-
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> FragmentShaderErrorMessage(InfoLogLength);
-	glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-	fprintf(stdout, "%s\n", &FragmentShaderErrorMessage[0]);
-
-	// Link the program
-	fprintf(stdout, "Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
-
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	std::vector<char> ProgramErrorMessage( max(InfoLogLength, int(1)) );
-	glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-	fprintf(stdout, "%s\n", &ProgramErrorMessage[0]);
-
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
-
-	return ProgramID;
-}
-
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
-{
-	struct VAO* vao = new struct VAO;
-	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
-	vao->FillMode = fill_mode;
-
-	// Create Vertex Array Object
-	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
-	glBindVertexArray (vao->VertexArrayID); // Bind the VAO
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+	glBindVertexArray (meshVertexArrayID);
+	glBindBuffer (GL_ARRAY_BUFFER, meshVertexBuffer);
+	glBufferData (GL_ARRAY_BUFFER, meshVertices.size()*sizeof(MeshVertex), &meshVertices[0], GL_STATIC_DRAW);
 	glVertexAttribPointer(
 			0,                  // attribute 0. Vertices
 			3,                  // size (x,y,z)
 			GL_FLOAT,           // type
 			GL_FALSE,           // normalized?
-			0,                  // stride
+			sizeof(MeshVertex), // stride
 			(void*)0            // array buffer offset
 			);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray (0);
+	invalidateGLState();
+}
 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-	glVertexAttribPointer(
-			1,                  // attribute 1. Color
-			3,                  // size (r,g,b)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-			);
+/* Draw 'mesh' in one colour, with programID and the mesh VAO in use */
+void drawMesh (struct Mesh* mesh, const glm::vec4& transform, const GLfloat* scale, const GLfloat* colour)
+{
+	// Change the Fill Mode for this object
+	setFillMode(mesh->FillMode);
+	setColor(colour);
+	setScale(scale);
+	glUniform4fv(TransformID, 1, &transform[0]);
+
+	// Draw the geometry !
+	glDrawArrays(mesh->PrimitiveMode, mesh->First, mesh->NumVertices);
+}
+
+/* Many copies of one mesh drawn with a single instanced call.
+   Each instance carries its own colour and XY offset in InstanceBuffer */
+struct InstanceBatch {
+	GLuint VertexArrayID;
+	GLint First;
+	GLuint InstanceBuffer;
+	GLuint ProgramID;
+
+	GLenum PrimitiveMode;
+	GLenum FillMode;
+	int NumVertices;
+	int Capacity; // instances InstanceBuffer currently has room for
+	std::vector<GLfloat> data; // r,g,b,x,y per instance, filled every frame
+};
+typedef struct InstanceBatch InstanceBatch;
+
+/* Generate a VAO sharing the vertices of 'mesh' with a per-instance buffer.
+   Call after uploadMeshes() */
+struct InstanceBatch* createInstanceBatch (struct Mesh* mesh, GLuint program_id)
+{
+	struct InstanceBatch* batch = new struct InstanceBatch;
+	batch->First = mesh->First;
+	batch->PrimitiveMode = mesh->PrimitiveMode;
+	batch->FillMode = mesh->FillMode;
+	batch->NumVertices = mesh->NumVertices;
+	batch->Capacity = 0;
+	batch->ProgramID = program_id;
+
+	glGenVertexArrays(1, &(batch->VertexArrayID));
+	glGenBuffers (1, &(batch->InstanceBuffer));
+
+	glBindVertexArray (batch->VertexArrayID);
+
+	// attribute 0 : vertices of the shared mesh buffer, advanced per vertex
+	glBindBuffer (GL_ARRAY_BUFFER, meshVertexBuffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	// attributes 1,2 : colour and offset, advanced once per instance
+	glBindBuffer (GL_ARRAY_BUFFER, batch->InstanceBuffer);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat), (void*)0);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5*sizeof(GLfloat), (void*)(3*sizeof(GLfloat)));
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
 
-	return vao;
+	glBindVertexArray (0);
+	invalidateGLState();
+	return batch;
 }
 
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+/* Queue one instance of the batch mesh for this frame */
+void pushInstance (struct InstanceBatch* batch, GLfloat x, GLfloat y, GLfloat red, GLfloat green, GLfloat blue)
 {
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-	for (int i=0; i<numVertices; i++) {
-		color_buffer_data [3*i] = red;
-		color_buffer_data [3*i + 1] = green;
-		color_buffer_data [3*i + 2] = blue;
-	}
+	batch->data.push_back(red);
+	batch->data.push_back(green);
+	batch->data.push_back(blue);
+	batch->data.push_back(x);
+	batch->data.push_back(y);
+}
+
+/* Upload the queued instances once and draw them all in one call */
+void drawInstanceBatch (struct InstanceBatch* batch)
+{
+	int count = batch->data.size()/5;
+	if (count == 0)
+		return;
 
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+	useProgram(batch->ProgramID);
+
+	glBindBuffer (GL_ARRAY_BUFFER, batch->InstanceBuffer);
+	// Grow geometrically so a steady stream of spawns reallocates rarely
+	if (count > batch->Capacity)
+		batch->Capacity = max(2*batch->Capacity, count);
+	// Orphan last frame's storage so the driver need not wait on it
+	glBufferData (GL_ARRAY_BUFFER, 5*batch->Capacity*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+	glBufferSubData (GL_ARRAY_BUFFER, 0, batch->data.size()*sizeof(GLfloat), &batch->data[0]);
+
+	setFillMode(batch->FillMode);
+	bindVertexArray(batch->VertexArrayID);
+	glDrawArraysInstanced(batch->PrimitiveMode, batch->First, batch->NumVertices, count);
+
+	batch->data.clear();
 }
 
-/* Render the VBOs handled by VAO */
-void draw3DObject (struct VAO* vao)
+/* draw() queues what it wants drawn; flushRenderQueue() sorts the queue by
+   key so that draws sharing state end up next to each other, then issues
+   it through the state cache, which drops the calls that change nothing.
+   Key, from the most significant bits :
+     layer 8 | program 8 | VAO 8 | fill mode 1 | mesh 16 | colour 15 | 0 8
+   The layer comes first so later layers still paint over earlier ones
+   (everything is at z=0 and passes GL_LEQUAL). Within a layer, draws are
+   reordered by state, so objects that must overlap in a fixed order go
+   in different layers. The sort is stable : equal keys keep their
+   submission order. */
+enum RenderLayer { LAYER_WORLD, LAYER_BLOCKS, LAYER_GUN, LAYER_BULLETS, LAYER_OVERLAY_P99, LAYER_OVERLAY_AVG };
+
+struct RenderItem {
+	unsigned long long Key;
+	struct Mesh* Mesh;            // NULL for an instance batch
+	struct InstanceBatch* Batch;
+	glm::vec4 Transform;          // x, y, cos, sin
+	GLfloat Scale[2];
+	GLfloat Color[3];
+};
+
+std::vector<RenderItem> renderQueue;
+
+unsigned long long renderKey (int layer, GLuint program, GLuint vao, GLenum fill_mode, int first, const GLfloat* colour)
 {
-	// Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+	// 5 bits per channel : the key only has to group equal colours
+	unsigned long long rgb = ((int)(colour[0]*31) << 10) | ((int)(colour[1]*31) << 5) | (int)(colour[2]*31);
+	return (unsigned long long)(layer & 0xFF) << 56
+		| (unsigned long long)(program & 0xFF) << 48
+		| (unsigned long long)(vao & 0xFF) << 40
+		| (unsigned long long)(fill_mode != GL_FILL) << 39
+		| (unsigned long long)(first & 0xFFFF) << 23
+		| rgb << 8;
+}
 
-	// Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
+/* Queue 'mesh' in 'colour' for this frame, placed by 'transform' (see
+   meshTransform) after scaling it by (scale_x, scale_y) */
+void submitMesh (int layer, struct Mesh* mesh, const glm::vec4& transform, const GLfloat* colour, GLfloat scale_x=1, GLfloat scale_y=1)
+{
+	RenderItem item;
+	item.Key = renderKey(layer, programID, meshVertexArrayID, mesh->FillMode, mesh->First, colour);
+	item.Mesh = mesh;
+	item.Batch = NULL;
+	item.Transform = transform;
+	item.Scale[0] = scale_x;
+	item.Scale[1] = scale_y;
+	memcpy(item.Color, colour, sizeof item.Color);
+	renderQueue.push_back(item);
+}
 
-	// Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+/* Queue an instance batch, drawn with what was pushed to it this frame */
+void submitInstanceBatch (int layer, struct InstanceBatch* batch)
+{
+	static const GLfloat none[3] = { 0, 0, 0 };
+	RenderItem item;
+	item.Key = renderKey(layer, batch->ProgramID, batch->VertexArrayID, batch->FillMode, batch->First, none);
+	item.Mesh = NULL;
+	item.Batch = batch;
+	renderQueue.push_back(item);
+}
 
-	// Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+bool renderItemLess (const RenderItem& a, const RenderItem& b)
+{
+	return a.Key < b.Key;
+}
 
-	// Draw the geometry !
-	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+/* Issue and empty the queue, with the camera already set */
+void flushRenderQueue ()
+{
+	stable_sort(renderQueue.begin(), renderQueue.end(), renderItemLess);
+	for (size_t i=0; i<renderQueue.size(); i++) {
+		RenderItem& item = renderQueue[i];
+		if (item.Batch) {
+			drawInstanceBatch(item.Batch);
+			continue;
+		}
+		useProgram(programID);
+		bindVertexArray(meshVertexArrayID);
+		drawMesh(item.Mesh, item.Transform, item.Scale, item.Color);
+	}
+	renderQueue.clear();
 }
 
 /**************************
  * Customizable functions *
  **************************/
-mpg123_handle *mh;
-    unsigned char *buffer;
-    size_t buffer_size;
-    size_t done;
-    int err;
-
-    int driver;
-    ao_device *dev;
-
-    ao_sample_format format;
-    int channels, encoding;
-    long rate;
-int t=0,reload=0;
-VAO *triangle,*bucket1, *bucket2,*gun1,*gun2,*bullet,*red_block,*green_block,*black_block,*mirror1,*mirror2,*mirror3,*mirror4;
+int reload=0;
+Mesh *bucket,*gun1,*gun2,*bullet,*block,*mirror,*profile_bar;
+const GLfloat red[3]={1,0,0}, green[3]={0,0.5,0}, blue[3]={0,0,1}, sky_blue[3]={0.52f,0.8f,0.98f}, grey[3]={0.2,0.2,0.2};
+const GLfloat blockColours[3][3]={ {1,0,0}, {0,0.5,0}, {0,0,0} }; // by BlockColour, for blocks and buckets
+InstanceBatch *blocks;
+int window_width=800, window_height=600;
+GLuint instancedProgramID, textProgramID, sparkProgramID;
 float triangle_rot_dir = 1,zoom=1,x_change=0,y_change=0;
 float rectangle_rot_dir = 1;
 bool triangle_rot_status = true;
 bool rectangle_rot_status = true;
-int countred=0,countgreen=0,countblack=0,countBullet=0,flagbullet[1000],flagblack[1000],flaggreen[1000],flagred[1000],flagbulletmirror1[1000],flagbulletmirror2[1000],flagbulletmirror3[1000],flagbulletmirror4[1000];
-float score=0,move1=0,move2=0,change=0,speed=0.03,current_time,rotation_angle=0,last_update_time,changered[1000]={4.5},changegreen[1000]={4.5},changeblack[1000]={4.5},xred[1000],xgreen[1000],xblack[1000],bulletx[1000],bullety[1000],adjusty[1000],rotationBullet[1000];
-void initialise()
+#define SIM_MAX_STEPS 8          // steps the simulation catches up by at most
+float render_alpha=0;            // fraction of a step draw() interpolates by
+bool offscreen=false;            // no window, see runOffscreen()
+const char* level_path=LEVEL_DEFAULT;
+Level level;                     // mapped while applied
+bool recording=false;
+
+/* Startup timing : each startupLap() closes the phase started by the
+   previous one (phases may repeat and add up), and the first frame on
+   screen prints the lot, for tuning cold starts */
+struct StartupPhase {
+	const char* Name;
+	unsigned long long Ns;
+};
+std::vector<StartupPhase> startupPhases;
+unsigned long long startup_origin=0, startup_last=0;
+bool startup_reported=false;
+
+void startupLap (const char* name)
+{
+	unsigned long long now=profileNow();
+	size_t i=0;
+	while(i<startupPhases.size() && strcmp(startupPhases[i].Name,name))
+		i++;
+	if(i==startupPhases.size())
+	{
+		StartupPhase phase = { name, 0 };
+		startupPhases.push_back(phase);
+	}
+	startupPhases[i].Ns+=now-startup_last;
+	startup_last=now;
+}
+
+void startupReport ()
+{
+	// the frame is on screen once the GPU is done with it
+	glFinish();
+	startupLap("first_frame");
+	startup_reported=true;
+	for(size_t i=0;i<startupPhases.size();i++)
+		printf("startup %-12s %8.2f ms\n", startupPhases[i].Name, startupPhases[i].Ns/1e6);
+	printf("startup %-12s %8.2f ms (shader programs: %d cached, %d compiled)\n", "total",
+		(startup_last-startup_origin)/1e6, shader_cache_hits, shader_cache_misses);
+}
+
+/* Switch to a loaded level, releasing the one it replaces */
+void useLevel (Level& loaded)
+{
+	applyLevel(loaded);
+	if(level.map)
+		levelRelease(level);
+	level=loaded;
+}
+
+/* Load the level file at startup, or play the built-in level */
+void loadLevel ()
+{
+	Level loaded;
+	if(levelLoad(level_path,loaded))
+		useLevel(loaded);
+	else
+		cout<<"Playing the built-in level"<<endl;
+}
+
+/* Hot reloading. The asset watcher's thread (asset_watch.h) does what
+   can run on any thread : compiling levels and reloading sound effects.
+   Applying a level between two steps is queued for the simulation
+   thread, and rebuilding shader programs, which needs the GL context,
+   for the render thread */
+SPSCQueue<Level> levelReloads;
+SPSCQueue<const char*> shaderReloads; // the edited files
+
+/* The programs draw() uses, and the files they are built from. A program
+   is swapped only once its rebuild links and has the interface draw()
+   relies on; until then, or if it fails, the old one keeps drawing */
+struct ShaderProgram {
+	GLuint* ID;
+	const char* Vertex;
+	const char* Fragment;
+	ShaderBuild Build;         // Build.program != 0 while rebuilding
+	bool Pending;              // edited again during the rebuild
+};
+ShaderProgram shaderPrograms[] = {
+	{ &programID, "Sample_GL.vert", "Sample_GL.frag", ShaderBuild(), false },
+	{ &instancedProgramID, "Sample_GL_instanced.vert", "Sample_GL.frag", ShaderBuild(), false },
+	{ &textProgramID, "Sample_GL_text.vert", "Sample_GL_text.frag", ShaderBuild(), false },
+	{ &sparkProgramID, "Sample_GL_text.vert", "Sample_GL_sparks.frag", ShaderBuild(), false },
+};
+#define SHADER_PROGRAMS (int)(sizeof shaderPrograms/sizeof shaderPrograms[0])
+
+/* Watcher thread : called with every file written in a watched directory */
+void assetChanged (const char* path)
+{
+	if(!strcmp(path,level_path))
+	{
+		Level loaded;
+		// on errors the message says why, and the current level stays
+		if(levelLoad(level_path,loaded) && !levelReloads.push(loaded))
+			levelRelease(loaded);
+		return;
+	}
+	const char* shader=NULL;
+	for(int i=0;i<SHADER_PROGRAMS && !shader;i++)
+		if(!strcmp(path,shaderPrograms[i].Vertex))
+			shader=shaderPrograms[i].Vertex;
+		else if(!strcmp(path,shaderPrograms[i].Fragment))
+			shader=shaderPrograms[i].Fragment;
+	if(shader)
+		shaderReloads.push(shader);
+	else if(audioReloadEffect(path))
+		cout<<"Reloaded "<<path<<endl;
+}
+
+/* Put a rebuilt program in use between two frames */
+void swapProgram (ShaderProgram& program, GLuint id)
+{
+	glDeleteProgram(*program.ID);
+	*program.ID=id;
+	useCamera(id);
+	if(program.ID==&programID)
+	{
+		TransformID = glGetUniformLocation(programID, "objectTransform");
+		ScaleID = glGetUniformLocation(programID, "objectScale");
+		ColorID = glGetUniformLocation(programID, "objectColor");
+	}
+	blocks->ProgramID=instancedProgramID;
+	// the cached uniforms belonged to the old program
+	invalidateGLState();
+}
+
+/* Simulation thread : switch to a reloaded level between two steps */
+void applyLevelReloads ()
+{
+	Level loaded;
+	while(levelReloads.pop(loaded))
+	{
+		// a recording names one level, which must stay put
+		if(recording)
+		{
+			cout<<"Not reloading "<<level_path<<" while recording"<<endl;
+			levelRelease(loaded);
+			continue;
+		}
+		cout<<"Reloaded "<<level_path<<endl;
+		useLevel(loaded);
+	}
+}
+
+/* Render thread : start rebuilding edited programs and swap in the
+   finished ones */
+void applyShaderReloads ()
 {
+	const char* path;
 	int i;
-	srand(time(NULL));
-	for(i=0;i<1000;i++)
+	while(shaderReloads.pop(path))
+	{
+		for(i=0;i<SHADER_PROGRAMS;i++)
+		{
+			ShaderProgram& program=shaderPrograms[i];
+			if(strcmp(path,program.Vertex) && strcmp(path,program.Fragment))
+				continue;
+			if(program.Build.program)
+				program.Pending=true;
+			else
+				shaderBuildStart(program.Build, program.Vertex, program.Fragment);
+		}
+	}
+	for(i=0;i<SHADER_PROGRAMS;i++)
+	{
+		ShaderProgram& program=shaderPrograms[i];
+		if(!program.Build.program || !shaderBuildReady(program.Build))
+			continue;
+		GLuint id=shaderBuildFinish(program.Build);
+		if(id && glGetUniformBlockIndex(id, "Camera")==GL_INVALID_INDEX)
+		{
+			cout<<program.Build.name<<" has no Camera block, not used"<<endl;
+			glDeleteProgram(id);
+			id=0;
+		}
+		if(id)
+		{
+			cout<<"Reloaded "<<program.Build.name<<endl;
+			swapProgram(program, id);
+		}
+		if(program.Pending)
+		{
+			program.Pending=false;
+			shaderBuildStart(program.Build, program.Vertex, program.Fragment);
+		}
+	}
+}
+
+void initialise(unsigned int seed)
+{
+	resetGame(seed);
+}
+
+ParticlePool particles;                // the simulation thread's
+const GLfloat background[3]={1,1,1};   // the clear colour, which particles fade into
+
+/* Sound and a burst of particles for everything the simulation reported
+   since the last call */
+void playEvents ()
+{
+	for(size_t i=0;i<gameEvents.size();i++)
+	{
+		const GameEvent& e=gameEvents[i];
+		audioPlay(e.type);
+		// debris in the colour of the block involved
+		const GLfloat* c=e.colour>=0 ? blockColours[e.colour] : sky_blue;
+		switch(e.type)
+		{
+			case EV_HIT: emitBurst(particles, e.x, e.y, 60, 2.5f, 0.6f, c); break;
+			case EV_CATCH:
+			case EV_WRONG_BUCKET: emitBurst(particles, e.x, e.y, 40, 1.5f, 0.5f, c); break;
+			case EV_BOUNCE: emitBurst(particles, e.x, e.y, 12, 1.2f, 0.25f, c); break;
+			case EV_GAME_OVER: emitBurst(particles, e.x, e.y, 600, 4.0f, 1.2f, c); break;
+		}
+	}
+	gameEvents.clear();
+}
+
+/* Player input reaches the simulation as timestamped events through a
+   lock-free queue : the GLUT callbacks only push, and the fixed step
+   drains the queue at tick boundaries on its own thread. The callbacks
+   keep the view (zoom, pan) to themselves and change no game state. The
+   timestamps are taken as GLUT hands an event over, and the input profile
+   phase measures from there to the end of the first frame drawn after
+   the event's tick */
+#define INPUT_QUEUE 256
+struct InputEvent {
+	int Action;
+	float Value;
+	unsigned long long Time;   // profileNow() when it arrived
+};
+SPSCQueue<InputEvent> inputQueue;
+
+/* Queue a player action for the next tick */
+void playerAction (int action, float value)
+{
+	InputEvent e = { action, value, profileNow() };
+	inputQueue.push(e); // only full if the simulation stalled; dropping is fine then
+}
+
+/* The simulation runs on its own thread, stepping at SIM_HZ on an
+   absolute schedule. After every step it publishes a snapshot of what is
+   drawn through a triple buffer, and the render thread draws the latest
+   one at whatever rate the display allows. Neither thread waits for the
+   other : the simulation owns the game state (game.h), the input queue's
+   consuming end and the audio triggers, the render thread owns GL and
+   only ever reads snapshots */
+struct FrameState {
+	GameSnapshot Game;
+	unsigned long long TickTime;   // profileNow() when the step ended
+	// input applied in the steps since the renderer last took a frame
+	std::vector<unsigned long long> InputTimes;
+	ParticleImage Particles;        // the live particles, painted
+};
+TripleBuffer<FrameState> frames;
+pthread_t sim_thread;
+std::atomic<bool> sim_running(false);
+
+/* Apply the queued input at a tick boundary, logging it first when a
+   session is recorded, as headless scripts apply theirs */
+void drainInput ()
+{
+	InputEvent e;
+	while(inputQueue.pop(e))
+	{
+		recordAction(t, e.Action, e.Value);
+		applyAction(e.Action, e.Value);
+		frames.writing().InputTimes.push_back(e.Time);
+	}
+}
+
+void publishFrame ()
+{
+	FrameState& frame=frames.writing();
+	captureSnapshot(frame.Game);
+	splatParticles(particles, frame.Particles, background);
+	frame.TickTime=profileNow();
+	// a frame the renderer skipped still owes it its input timestamps
+	if(!frames.publish())
+		frames.writing().InputTimes.clear();
+}
+
+/* One fixed step and its snapshot */
+void simStep ()
+{
+	if(!game_over)
+	{
+		applyLevelReloads();
+		drainInput();
+		simulate();
+	}
 	{
-		changered[i]=4.5;
-		xred[i]=(float)(((rand())%680-280)/100.0);
-		xgreen[i]=(float)(((rand())%680-280)/100.0);
-		xblack[i]=(float)(((rand())%680-280)/100.0);
-		changeblack[i]=4.5;
-		changegreen[i]=4.5;
-		bulletx[i]=0;
-		bullety[i]=0;
-		adjusty[i]=0;
-		rotationBullet[i]=0;
-		flagbullet[i]=0;
-		flagblack[i]=0;
-		flaggreen[i]=0;
-		flagred[i]=0;
-		flagbulletmirror1[i]=0;
-		flagbulletmirror2[i]=0;
-		flagbulletmirror3[i]=0;
-		flagbulletmirror4[i]=0;
+		ProfileTimer timer(PROF_PARTICLES);
+		stepParticles(particles);
+	}
+	playEvents();
+	publishFrame();
+}
 
+void* simLoop (void*)
+{
+	const unsigned long long step_ns=1000000000ULL/SIM_HZ;
+	unsigned long long next=profileNow();
+	// after game over only the particles go on, until the last one fades
+	while(sim_running.load() && (!game_over || particles.count))
+	{
+		next+=step_ns;
+		unsigned long long now=profileNow();
+		// far behind (debugger, suspended machine) : drop the time instead
+		// of spending ever longer catching up
+		if(now>next+SIM_MAX_STEPS*step_ns)
+			next=now;
+		else if(now<next)
+		{
+			struct timespec until = { (time_t)(next/1000000000ULL), (long)(next%1000000000ULL) };
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+		}
+		simStep();
 	}
+	return NULL;
+}
+
+/* Publish the starting state, then start stepping */
+void simStart ()
+{
+	publishFrame();
+	sim_running.store(true);
+	pthread_create(&sim_thread, NULL, simLoop, NULL);
+}
 
+/* Stop stepping; the game state belongs to the caller afterwards */
+void simStop ()
+{
+	if(sim_running.exchange(false))
+		pthread_join(sim_thread, NULL);
 }
-void* playsound(void *x)
+
+/* After a frame is on screen : it shows all input applied up to its step */
+void inputPresented ()
 {
-while(1)
+	std::vector<unsigned long long>& shown=frames.reading().InputTimes;
+	if(shown.empty())
+		return;
+	unsigned long long now=profileNow();
+	if(profile_enabled)
+		for(size_t i=0;i<shown.size();i++)
+			profileSample(PROF_INPUT, now-shown[i]);
+	shown.clear();
+}
+
+/* Every way out of the game : join the other threads before exiting */
+void quitGame (int status)
 {
- while (mpg123_read(mh, buffer, buffer_size, &done) == MPG123_OK)
-        ao_play(dev, (char *)buffer, done);
+	simStop();
+	watchStop();
+	audioStop();
+	exit(status);
 }
+
+/* Close the recording, if any, on every way out of the game */
+void endRecording ()
+{
+	simStop();
+	stopRecording(t, stateHash());
 }
 int control=0,alt=0;
+bool profile_overlay=false,profile_csv=false;
 /* Executed when a regular key is pressed */
 void keyboard (unsigned char key, int x, int y)
 {
@@ -260,43 +774,47 @@ void keyboard (unsigned char key, int x, int y)
 		case 27: //ESC
 			control=0;
 			alt=0;
-			exit (0);
+			quitGame(0);
 		case 32:
 			control=0;
 			alt=0;
-			countBullet++;
-			adjusty[countBullet]=change;
-			rotationBullet[countBullet]=rotation_angle;
+			playerAction(ACT_FIRE,0);
 			break;
 		case 'n':
 			control=0;
 			alt=0;
-			speed*=2;
+			playerAction(ACT_SPEED,2);
+			break;
+		case 'o':
+			control=0;
+			alt=0;
+			profile_overlay=!profile_overlay;
+			profile_enabled=profile_overlay || profile_csv;
 			break;
 		case 'm':
 			control=0;
 			alt=0;
-			speed/=2;
+			playerAction(ACT_SPEED,0.5);
 			break;
 		case 's':
 			control=0;
 			alt=0;
-			change+=0.2;
+			playerAction(ACT_GUN,0.2);
 			break;
 		case 'a':
 			control=0;
 			alt=0;
-			rotation_angle+=5;
+			playerAction(ACT_AIM,5);
 			break;
 		case 'd':
 			control=0;
 			alt=0;
-			rotation_angle-=5;
+			playerAction(ACT_AIM,-5);
 			break;
 		case 'f':
 			control=0;
 			alt=0;
-			change-=0.2;
+			playerAction(ACT_GUN,-0.2);
 			break;
 		default:
 			control=0;
@@ -357,17 +875,17 @@ void keyboardSpecialDown (int key, int x, int y)
 			break;
 		case 100:
 			if(control==1)
-				move1+=0.3;
+				playerAction(ACT_BUCKET1,0.3);
 			else if(alt==1)
-				move2+=0.3;
+				playerAction(ACT_BUCKET2,0.3);
 			else
 				x_change-=0.2;
 			break;
 		case 102:
 			if(control==1)
-				move1-=0.3;
+				playerAction(ACT_BUCKET1,-0.3);
 			else if(alt==1)
-				move2-=0.3;
+				playerAction(ACT_BUCKET2,-0.3);
 			else
 				x_change+=0.2;
 			break;
@@ -418,9 +936,7 @@ void mouseClick (int button, int state, int x, int y)
 			right_click=0;
 			if (state == 0)
 			{
-			countBullet++;
-			adjusty[countBullet]=change;
-			rotationBullet[countBullet]=rotation_angle;
+			playerAction(ACT_FIRE,0);
 
 			left_click=1;
 			check_redbucket=x;
@@ -462,28 +978,26 @@ void mouseMotion (int x, int y)
 	}
 	if(left_click==1)
 	{
-			if(-0.6f-2.0f-move1<=x/100.0-4.0f and x/100.0-4.0f<=0.6f-2.0f-move1 and 4.0-y/75.0<=-3.6)
-			{
-				if(x>=check_redbucket)
-				move1-=0.05;
-				else
-					move1+=0.05;
-				check_redbucket=x;
-			}
-			else if(-0.6f+2.0f-move2<=x/100.0-4.0f and x/100.0-4.0f<=0.6f+2.0f-move2 and 4.0-y/75.0<=-3.6)
+			// the player moves the first two buckets, where they are drawn
+			const GameSnapshot& game=frames.reading().Game;
+			int dragged=-1;
+			for(int k=0;k<(int)game.buckets.size() && k<2 && dragged<0;k++)
+				if(-0.6f+bucketX(game.buckets[k])<=x/100.0-4.0f and x/100.0-4.0f<=0.6f+bucketX(game.buckets[k]) and 4.0-y/75.0<=game.buckets[k].y)
+					dragged=k;
+			if(dragged>=0)
 			{
 				if(x>=check_redbucket)
-				move2-=0.05;
+				playerAction(ACT_BUCKET1+dragged,-0.05);
 				else
-					move2+=0.05;
+					playerAction(ACT_BUCKET1+dragged,0.05);
 				check_redbucket=x;
 			}
-			else if(x/100.0-4.0>=-4.0 and x/100.0-4.0<=-3.7)
+			else if(x/100.0-4.0>=game.gunX-0.25 and x/100.0-4.0<=game.gunX+0.05)
 			{
 				if(y>=check_gun)
-				change-=0.03;
+				playerAction(ACT_GUN,-0.03);
 				else
-					change+=0.03;
+					playerAction(ACT_GUN,0.03);
 				check_gun=y;
 			}
 	}
@@ -498,6 +1012,8 @@ void reshapeWindow (int width, int height)
 
 	// sets the viewport of openGL renderer
 	glViewport (0, 0, (GLsizei) width, (GLsizei) height);
+	window_width = width;
+	window_height = height;
 
 	// set the projection matrix as perspective/ortho
 	// Store the projection matrix in a variable for future use
@@ -510,32 +1026,12 @@ void reshapeWindow (int width, int height)
 }
 
 
-// Creates the triangle object used in this sample code
-void createTriangle ()
-{
-	/* ONLY vertices between the bounds specified in glm::ortho will be visible on screen */
-
-	/* Define vertex array as used in glBegin (GL_TRIANGLES) */
-	static const GLfloat vertex_buffer_data [] = {
-		0, 1,0, // vertex 0
-		-1,-1,0, // vertex 1
-		1,-1,0, // vertex 2
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		1,0,0, // color 0
-		0,1,0, // color 1
-		0,0,1, // color 2
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	triangle = create3DObject(GL_TRIANGLES, 12, vertex_buffer_data, color_buffer_data, GL_LINE);
-}
-
-void createbucket1 ()
+/* The shapes, one mesh each however many objects share the shape.
+   Colours are given when drawing */
+void createBucket ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
+	static const GLfloat vertex_buffer_data [] = {
 
 		-0.4,0.4,0, // vertex 1
 		-0.4,-0.4,0, // vertex 2
@@ -554,31 +1050,12 @@ void createbucket1 ()
 		-0.4,-0.4,0 //vertex 2
 	};
 
-	static const GLfloat color_buffer_data [] = {
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0, // color 1
-
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0, // color 1
-
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0, // color 1
-
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0 // color 1
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	bucket1 = create3DObject(GL_TRIANGLES, 12, vertex_buffer_data, color_buffer_data, GL_FILL);
+	bucket = addMesh(GL_TRIANGLES, 12, vertex_buffer_data, GL_FILL);
 }
-void createmirror1 ()
+void createMirror ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
+	static const GLfloat vertex_buffer_data [] = {
 		-0.4,0.025,0, // vertex 1
 		-0.4,-0.025,0, // vertex 2
 		0.4, -0.025,0, // vertex 3
@@ -588,224 +1065,43 @@ void createmirror1 ()
 		-0.4,0.025,0,  // vertex 1
 	};
 
-	static const GLfloat color_buffer_data [] = {
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	mirror1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+	mirror = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
 }
-void createmirror2 ()
+void createBlock ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.4,0.025,0, // vertex 1
-		-0.4,-0.025,0, // vertex 2
-		0.4, -0.025,0, // vertex 3
-
-		0.4, -0.025,0, // vertex 3
-		0.4, 0.025,0, // vertex 4
-		-0.4,0.025,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
+	static const GLfloat vertex_buffer_data [] = {
+		-0.1,0.1,0, // vertex 1
+		-0.1,-0.1,0, // vertex 2
+		0.1, -0.1,0, // vertex 3
 
+		0.1, -0.1,0, // vertex 3
+		0.1, 0.1,0, // vertex 4
+		-0.1,0.1,0,  // vertex 1
 	};
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	mirror2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+	block = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
 }
-void createmirror3 ()
+void createBullet ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.4,0.025,0, // vertex 1
-		-0.4,-0.025,0, // vertex 2
-		0.4, -0.025,0, // vertex 3
-
-		0.4, -0.025,0, // vertex 3
-		0.4, 0.025,0, // vertex 4
-		-0.4,0.025,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
+	static const GLfloat vertex_buffer_data [] = {
+		-3.5,0.05,0, // vertex 1
+		-3.5,-0.05,0, // vertex 2
+		-3.4, -0.05,0, // vertex 3
 
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
 
+		-3.4, -0.05,0, // vertex 3
+		-3.4,0.05,0, // vertex 4
+		-3.5,0.05,0,  // vertex 1
 	};
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	mirror3 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+	bullet = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
 }
-void createmirror4 ()
+void createGun1 ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.4,0.025,0, // vertex 1
-		-0.4,-0.025,0, // vertex 2
-		0.4, -0.025,0, // vertex 3
-
-		0.4, -0.025,0, // vertex 3
-		0.4, 0.025,0, // vertex 4
-		-0.4,0.025,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-		0.52f,0.8f,0.98f, // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	mirror4 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createblack_block ()
-{
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.1,0.1,0, // vertex 1
-		-0.1,-0.1,0, // vertex 2
-		0.1, -0.1,0, // vertex 3
-
-		0.1, -0.1,0, // vertex 3
-		0.1, 0.1,0, // vertex 4
-		-0.1,0.1,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0,0,0, // color 1
-		0,0,0, // color 1
-		0,0,0, // color 1
-
-		0,0,0, // color 1
-		0,0,0, // color 1
-		0,0,0, // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	black_block = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void creategreen_block ()
-{
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.1,0.1,0, // vertex 1
-		-0.1,-0.1,0, // vertex 2
-		0.1, -0.1,0, // vertex 3
-
-		0.1, -0.1,0, // vertex 3
-		0.1, 0.1,0, // vertex 4
-		-0.1,0.1,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	green_block = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createred_block ()
-{
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.1,0.1,0, // vertex 1
-		-0.1,-0.1,0, // vertex 2
-		0.1, -0.1,0, // vertex 3
-
-		0.1, -0.1,0, // vertex 3
-		0.1, 0.1,0, // vertex 4
-		-0.1,0.1,0,  // vertex 1
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0, // color 1
-
-		1,0,0, // color 1
-		1,0,0, // color 1
-		1,0,0, // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	red_block = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createBullet ()
-{
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-3.5,0.05,0, // vertex 1
-		-3.5,-0.05,0, // vertex 2
-		-3.4, -0.05,0, // vertex 3
-
-
-		-3.4, -0.05,0, // vertex 3
-		-3.4,0.05,0, // vertex 4
-		-3.5,0.05,0,  // vertex 1
-
-		//-3.87, -0.05,0, // vertex 3
-		//-3.87,0.05,0, // vertex 4
-		//-3.80,0,0  // vertex 1
-
-
-	};
-
-	static const GLfloat color_buffer_data [] = {
-		0.2,0.2,0.2, // color 1
-		0.2,0.2,0.2, // color 1
-		0.2,0.2,0.2, // color 1
-
-		0.2,0.2,0.2, // color 1
-		0.2,0.2,0.2, // color 1
-		0.2,0.2,0.2, // color 1
-
-		//0.2,0.2,0.2, // color 1
-		//0.2,0.2,0.2, // color 1
-		//0.2,0.2,0.2 // color 1
-
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	bullet = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createGun1 ()
-{
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
+	static const GLfloat vertex_buffer_data [] = {
 		-4,0.3,0, // vertex 1
 		-4,-0.3,0, // vertex 2
 		-3.7, -0.3,0, // vertex 3
@@ -815,23 +1111,12 @@ void createGun1 ()
 		-4,0.3,0,  // vertex 1
 	};
 
-	static const GLfloat color_buffer_data [] = {
-		0,0,1, // color 1
-		0,0,1, // color 1
-		0,0,1, // color 1
-
-		0,0,1, // color 1
-		0,0,1, // color 1
-		0,0,1, // color 1
-	};
-
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	gun1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+	gun1 = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
 }
 void createGun2 ()
 {
 	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
+	static const GLfloat vertex_buffer_data [] = {
 		-3.9, -0.05,0, // vertex 3
 		-3.9,0.05,0, // vertex 4
 		-3,0.05,0,  // vertex 1
@@ -839,85 +1124,266 @@ void createGun2 ()
 		-3,0.05,0,
 		-3,-0.05,0,
 		-3.9,-0.05,0
-
-
-
 	};
 
-	static const GLfloat color_buffer_data [] = {
-		0,0,1, // color 1
-		0,0,1, // color 1
-		0,0,1, // color 1
+	gun2 = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
+}
+void createProfileBar ()
+{
+	// unit square from (0,0) to (1,1), scaled per bar
+	static const GLfloat vertex_buffer_data [] = {
+		0,0,0, 1,0,0, 1,1,0,
+		1,1,0, 0,1,0, 0,0,0,
+	};
+	profile_bar = addMesh(GL_TRIANGLES, 6, vertex_buffer_data, GL_FILL);
+}
 
-		0,0,1, // color 1
-		0,0,1, // color 1
-		0,0,1, // color 1
+float camera_rotation_angle = 90;
+float rectangle_rotation = 0;
+float triangle_rotation = 0;
 
-	};
+/* GL timer queries around the draw submission. Results are read back
+   GPU_QUERIES frames later so reading them never stalls the pipeline */
+#define GPU_QUERIES 4
+GLuint gpuQueries[GPU_QUERIES];
+int gpuQueryFrame=0;
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	gun2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-void createbucket2 ()
+void beginGPUTimer ()
 {
-	// GL3 accepts only Triangles. Quads are not supported static
-	const GLfloat vertex_buffer_data [] = {
-		-0.4,0.4,0, // vertex 1
-		-0.4,-0.4,0, // vertex 2
-		0.4, -0.4,0, // vertex 3
+	GLuint query = gpuQueries[gpuQueryFrame%GPU_QUERIES];
+	if(gpuQueryFrame>=GPU_QUERIES)
+	{
+		GLint available=0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+		{
+			GLuint64 ns;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			profileSample(PROF_GPU, ns);
+		}
+	}
+	glBeginQuery(GL_TIME_ELAPSED, query);
+}
 
-		0.4, -0.4,0, // vertex 3
-		0.4, 0.4,0, // vertex 4
-		-0.4,0.4,0,  // vertex 1
+void endGPUTimer ()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	gpuQueryFrame++;
+}
 
-		0.4,0.4,0, //vertex 4
-		0.6,0.4,0, //vertex 5
-		0.4,-0.4,0, //vertex 3
+/* One bar pair per profiler phase down the top left of the screen, in
+   ProfilePhase order : red is the p99 of the last second, grey the mean,
+   drawn over it.
+   Bar length is log10(1 + microseconds) * 1.3 units, so 10us, 1ms and
+   100ms sit at roughly 1.4, 3.9 and 6.5 units */
+float overlayBarLength (double us)
+{
+	return log10(1+us)*1.3;
+}
 
-		-0.4,0.4,0, //vertex 1
-		-0.6,0.4,0, //vertex 6
-		-0.4,-0.4,0 //vertex 2
-	};
+void drawProfileOverlay ()
+{
+	static const GLfloat avgColour[3]={0.35,0.35,0.35}, p99Colour[3]={0.9,0.3,0.3};
+	// fixed to the screen : ignores zoom and pan
+	glm::mat4 VP = glm::ortho(-4.0f, 4.0f, -4.0f, 4.0f, 0.1f, 500.0f) * Matrices.view;
+	glDisable (GL_DEPTH_TEST);
+	for(int p=0;p<PROF_PHASES;p++)
+	{
+		if(profileStats[p].count==0)
+			continue;
+		float y=3.8-p*0.15;
+		submitMesh(LAYER_OVERLAY_P99, profile_bar, meshTransform(-3.9f, y, 0), p99Colour, overlayBarLength(profileStats[p].p99), 0.1f);
+		submitMesh(LAYER_OVERLAY_AVG, profile_bar, meshTransform(-3.9f, y, 0), avgColour, overlayBarLength(profileStats[p].avg), 0.1f);
+	}
+	setCamera(VP);
+	flushRenderQueue();
+	glEnable (GL_DEPTH_TEST);
+}
 
-	static const GLfloat color_buffer_data [] = {
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
+/* The HUD (hud.h) : the font atlas in a texture and every line of text
+   in one vertex buffer, uploaded only when some line changed and drawn
+   in a single call over everything else */
+GLuint hudVertexArrayID, hudBuffer, hudAtlas;
+int hudVertexCount=0;
+std::vector<GLfloat> hudData;
 
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
+void createHud ()
+{
+	unsigned char pixels[HUD_ATLAS_W*HUD_ATLAS_H];
+	hudBakeAtlas(pixels);
+	glGenTextures(1, &hudAtlas);
+	glBindTexture(GL_TEXTURE_2D, hudAtlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, HUD_ATLAS_W, HUD_ATLAS_H, 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+	// font pixels stay crisp squares at integer scales
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenVertexArrays(1, &hudVertexArrayID);
+	glGenBuffers(1, &hudBuffer);
+	glBindVertexArray(hudVertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, hudBuffer);
+	// attributes 0,1,2 : position, atlas coordinates and colour
+	GLsizei stride = HUD_VERTEX_FLOATS*sizeof(GLfloat);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2*sizeof(GLfloat)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(4*sizeof(GLfloat)));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+	invalidateGLState();
+}
 
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
+/* Score and speed top right, and the frame timing below them while the
+   profiler runs. Timings come from the profiler's last one second
+   window, so even they change the text only once a second */
+void drawHud (const GameSnapshot& game)
+{
+	static const GLfloat ink[3]={0,0,0}, dim[3]={0.35,0.35,0.35};
+	const float scale=2, right=window_width-8, line=(HUD_GLYPH_H+3)*scale;
+	char text[64];
+	snprintf(text, sizeof text, "SCORE %g", game.score);
+	hudSetLine(0, text, right-hudTextWidth(text, scale), 8, scale, ink);
+	snprintf(text, sizeof text, "SPEED %.2f", game.speed);
+	hudSetLine(1, text, right-hudTextWidth(text, scale), 8+line, scale, ink);
+	if(profile_enabled)
+	{
+		const ProfileStats& frame=profileStats[PROF_FRAME];
+		snprintf(text, sizeof text, "FRAME %.2f MS  P99 %.2f MS", frame.avg/1000, frame.p99/1000);
+		hudSetLine(2, text, right-hudTextWidth(text, scale), 8+2*line, scale, dim);
+		snprintf(text, sizeof text, "FPS %.0f  HUD %.3f MS", frame.avg>0 ? 1e6/frame.avg : 0, profileStats[PROF_DRAW_HUD].avg/1000);
+		hudSetLine(3, text, right-hudTextWidth(text, scale), 8+3*line, scale, dim);
+	}
+	else
+	{
+		hudSetLine(2, "", 0, 0, scale, dim);
+		hudSetLine(3, "", 0, 0, scale, dim);
+	}
+	if(hudVertices(hudData))
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, hudBuffer);
+		glBufferData(GL_ARRAY_BUFFER, hudData.size()*sizeof(GLfloat), hudData.empty() ? NULL : &hudData[0], GL_DYNAMIC_DRAW);
+		hudVertexCount=hudData.size()/HUD_VERTEX_FLOATS;
+	}
+	if(hudVertexCount==0)
+		return;
+	// window pixels, y down, as the lines are laid out
+	setCamera(glm::ortho(0.0f, (float)window_width, (float)window_height, 0.0f, -1.0f, 1.0f));
+	glDisable (GL_DEPTH_TEST);
+	useProgram(textProgramID);
+	bindVertexArray(hudVertexArrayID);
+	setFillMode(GL_FILL);
+	glBindTexture(GL_TEXTURE_2D, hudAtlas);
+	glDrawArrays(GL_TRIANGLES, 0, hudVertexCount);
+	glEnable (GL_DEPTH_TEST);
+}
 
-		0,0.5,0, // color 1
-		0,0.5,0, // color 1
-		0,0.5,0 // color 1
-	};
+/* The particles (particles.h) : the image the simulation painted, in a
+   texture laid over the playfield. Only the rows that hold particles
+   now or held them in the last uploaded image are sent again */
+GLuint sparkVertexArrayID, sparkBuffer, sparkImage;
+int sparkRowLo=0, sparkRowHi=0;   // rows of the texture holding particles
 
-	// create3DObject creates and returns a handle to a VAO that can be used later
-	bucket2 = create3DObject(GL_TRIANGLES, 12, vertex_buffer_data, color_buffer_data, GL_FILL);
+void createSparks ()
+{
+	int i;
+	const int n=PARTICLE_IMAGE_TEXELS;
+	std::vector<unsigned int> clear(n*n, 0);
+	glGenTextures(1, &sparkImage);
+	glBindTexture(GL_TEXTURE_2D, sparkImage);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, n, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, &clear[0]);
+	// a particle stays a sharp square of texels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// the HUD's vertex layout, so the text vertex shader draws it too
+	const GLfloat lo=PARTICLE_IMAGE_MIN, hi=PARTICLE_IMAGE_MIN+PARTICLE_IMAGE_SPAN;
+	static const int corners[6][2]={ {0,0}, {1,0}, {1,1}, {1,1}, {0,1}, {0,0} };
+	GLfloat quad[6*HUD_VERTEX_FLOATS]={};
+	for(i=0;i<6;i++)
+	{
+		GLfloat* v=quad+i*HUD_VERTEX_FLOATS;
+		v[0]=corners[i][0] ? hi : lo;
+		v[1]=corners[i][1] ? hi : lo;
+		v[2]=corners[i][0];
+		v[3]=corners[i][1];
+	}
+	glGenVertexArrays(1, &sparkVertexArrayID);
+	glGenBuffers(1, &sparkBuffer);
+	glBindVertexArray(sparkVertexArrayID);
+	glBindBuffer(GL_ARRAY_BUFFER, sparkBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof quad, quad, GL_STATIC_DRAW);
+	GLsizei stride = HUD_VERTEX_FLOATS*sizeof(GLfloat);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2*sizeof(GLfloat)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(4*sizeof(GLfloat)));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glBindVertexArray(0);
+	invalidateGLState();
 }
 
-
-float camera_rotation_angle = 90;
-float rectangle_rotation = 0;
-float triangle_rotation = 0;
+/* Drawn after the render queue with its world camera, over the scene
+   as the particles used to be */
+void drawSparks (const ParticleImage& image)
+{
+	const int n=PARTICLE_IMAGE_TEXELS;
+	int lo=image.row_lo, hi=image.row_hi;
+	if(sparkRowLo<sparkRowHi)
+	{
+		lo=(lo<hi) ? min(lo, sparkRowLo) : sparkRowLo;
+		hi=max(hi, sparkRowHi);
+	}
+	glBindTexture(GL_TEXTURE_2D, sparkImage);
+	if(lo<hi)
+	{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, lo, n, hi-lo, GL_RGBA, GL_UNSIGNED_BYTE, &image.texels[lo*n]);
+	}
+	sparkRowLo=image.row_lo;
+	sparkRowHi=image.row_hi;
+	if(image.count==0)
+		return;
+	useProgram(sparkProgramID);
+	bindVertexArray(sparkVertexArrayID);
+	setFillMode(GL_FILL);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+}
 
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
 void draw ()
 {
 	int i;
+	// time between frames, and GPU time of this frame's submission
+	bool gpu_timing = profile_enabled;
+	static unsigned long long last_frame = 0;
+	if(gpu_timing)
+	{
+		unsigned long long now = profileNow();
+		if(last_frame)
+			profileSample(PROF_FRAME, now-last_frame);
+		last_frame = now;
+		beginGPUTimer();
+	}
+	else
+		last_frame = 0;
+	// the latest step the simulation published, drawn as if a little
+	// later by interpolating towards it
+	frames.update();
+	const GameSnapshot& game=frames.reading().Game;
+	// offscreen frames are exactly one step apart, and reproducible
+	render_alpha=offscreen ? 1 : min(1.0f, (profileNow()-frames.reading().TickTime)*1e-9f*SIM_HZ);
+
 	// clear the color and depth in the frame buffer
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// use the loaded shader program
-	// Don't change unless you know what you are doing
-	glUseProgram (programID);
-
 	// Eye - Location of camera. Don't change unless you are sure!!
 	glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
 	// Target - Where is the camera looking at.  Don't change unless you are sure!!
@@ -935,432 +1401,61 @@ void draw ()
 	//  Don't change unless you are sure!!
 	glm::mat4 VP = Matrices.projection * Matrices.view;
 
-	// Send our transformation to the currently bound shader, in the "MVP" uniform
-	// For each model you render, since the MVP will be different (at least the M part)
-	//  Don't change unless you are sure!!
-	glm::mat4 MVP;	// MVP = Projection * View * Model
-	//mirror1
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatemirror1 = glm::translate (glm::vec3(3.0f, 0.0f, 0.0f)); // glTranslatef
-	glm::mat4 rotatemirror1 = glm::rotate((float)(90*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= translatemirror1*rotatemirror1;
-	MVP = VP * Matrices.model; // MVP = p * V * M
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	srand(time(NULL));
-	draw3DObject(mirror1);
-	//mirror2
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatemirror2 = glm::translate (glm::vec3(2.0f, 3.0f, 0.0f)); // glTranslatef
-	glm::mat4 rotatemirror2 = glm::rotate((float)(120*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= translatemirror2*rotatemirror2;
-	MVP = VP * Matrices.model; // MVP = p * V * M
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	srand(time(NULL));
-	draw3DObject(mirror2);
-	//mirror3
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatemirror3 = glm::translate (glm::vec3(1.0f, -2.0f, 0.0f)); // glTranslatef
-	glm::mat4 rotatemirror3 = glm::rotate((float)(60*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= translatemirror3*rotatemirror3;
-	MVP = VP * Matrices.model; // MVP = p * V * M
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	srand(time(NULL));
-	draw3DObject(mirror3);
-	//mirror4
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatemirror4 = glm::translate (glm::vec3(-2.5f, 2.5f, 0.0f)); // glTranslatef
-	glm::mat4 rotatemirror4 = glm::rotate((float)(15*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= translatemirror4*rotatemirror4;
-	MVP = VP * Matrices.model; // MVP = p * V * M
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	srand(time(NULL));
-	draw3DObject(mirror4);
-	///Reflection from mirrors
-	float cx,bx,cy,by,w,bw;
-	int j=0;
-	for(i=1;i<=countBullet;i++)
-	{
-		cx=-3.45+bulletx[i];
-		cy=adjusty[i]+bullety[i];
-		w=0.05;
-		if(flagbullet[i]==0 && flagbulletmirror1[i]==0)
-		{
-			bx=3;
-			by=0;
-			bw=0.025;
-			if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.4))
-			{
-				flagbulletmirror1[i]=1;
-				rotationBullet[i]=2*90-rotationBullet[i];
-				break;
-			}
-		}
-
-		if(flagbullet[i]==0 && flagbulletmirror2[i]==0)
-		{
-			bx=2;
-			by=3;
-			bw=0.04;
-			if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.4))
-			{
-				flagbulletmirror2[i]=1;
-				rotationBullet[i]=2*120-rotationBullet[i];
-				break;
-			}
-
-
-
-
-		}
-		if(flagbullet[i]==0 && flagbulletmirror3[i]==0)
-		{
-			bx=1;
-			by=-2;
-			bw=0.04;
-			if((abs(bx-cx)<=w+bw) && (abs(by-cy)<=w+0.4))
-			{
-				flagbulletmirror3[i]=1;
-				rotationBullet[i]=2*60-rotationBullet[i];
-				break;
-			}
-
-
-
-
-		}
-		if(flagbullet[i]==0 && flagbulletmirror4[i]==0)
-		{
-			bx=-2.5;
-			by=2.5;
-			bw=0.025;
-
-			if((abs(bx-cx)<=0.4) && (abs(by-cy)<=0.4))
-			{
-				flagbulletmirror4[i]=1;
-				rotationBullet[i]=2*15-rotationBullet[i];
-				break;
-			}
-
-
-
-
-		}
-	}
-	//bucket1
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatebucket1 = glm::translate (glm::vec3(-2.0f-move1, -3.6f, 0.0f)); // glTranslatef
-	Matrices.model *= translatebucket1;
-	MVP = VP * Matrices.model; // MVP = p * V * M
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	srand(time(NULL));
-	draw3DObject(bucket1);
-
-	/*colision with bucket1 and bucket2*/
-	for(i=1;i<=countblack;i++)
-	{
-		if(flagblack[i]==0)
-		{
-			if((-0.1+changeblack[i]<=-3.2))
-			{
-				if( ((-0.6f-2.0f-move1<=-0.1+xblack[i]) and (-0.1+xblack[i]<=0.6f-2.0f-move1)) or ((-0.6f-2.0f-move1<=0.1+xblack[i]) and (0.1+xblack[i]<=0.6f-2.0f-move1)))
-				{
-					flagblack[i]=1;
-					cout<<"Game Over"<<endl;
-					cout<<"Total score:"<<score<<endl;
-					exit(0);
-					break;
-
-				}
-			}
-
-
-
-		}
-		if(flagblack[i]==0)
-		{
-			if((-0.1+changeblack[i]<=-3.2))
-			{
-				if( ((-0.6f+2.0f-move2<=-0.1+xblack[i]) and (-0.1+xblack[i]<=0.6f+2.0f-move2)) or ((-0.6f+2.0f-move2<=0.1+xblack[i]) and (0.1+xblack[i]<=0.6f+2.0f-move2)))
-
-				{
-					flagblack[i]=1;
-					cout<<"Game Over"<<endl;
-					cout<<"Total score:"<<score<<endl;
-					exit(0);
-					break;
-
-				}
-			}
-
-
-
-		}
-
-
-	}
-	for(i=1;i<=countred;i++)
-	{
-		if(flagred[i]==0)
-		{
-			if((-0.1+changered[i]<=-3.2))
-			{
-				if( ((-0.6f-2.0f-move1<=-0.1+xred[i]) and (-0.1+xred[i]<=0.6f-2.0f-move1)) or ((-0.6f-2.0f-move1<=0.1+xred[i]) and (0.1+xred[i]<=0.6f-2.0f-move1)))
-				{
-					flagred[i]=1;
-					score+=4;
-					break;
-
-				}
-			}
-
-
-
-		}
-		if(flagred[i]==0)
-		{
-			if((-0.1+changered[i]<=-3.2))
-			{
-				if( ((-0.6f+2.0f-move2<=-0.1+xred[i]) and (-0.1+xred[i]<=0.6f+2.0f-move2)) or ((-0.6f+2.0f-move2<=0.1+xred[i]) and (0.1+xred[i]<=0.6f+2.0f-move2)))
-
-				{
-					flagred[i]=1;
-					score-=1;
-					break;
-
-				}
-			}
-
-
-
-		}
-
-
-	}
-	for(i=1;i<=countgreen;i++)
-	{
-		if(flaggreen[i]==0)
-		{
-			if((-0.1+changegreen[i]<=-3.2))
-			{
-				if( ((-0.6f-2.0f-move1<=-0.1+xgreen[i]) and (-0.1+xgreen[i]<=0.6f-2.0f-move1)) or ((-0.6f-2.0f-move1<=0.1+xgreen[i]) and (0.1+xgreen[i]<=0.6f-2.0f-move1)))
-				{
-					flaggreen[i]=1;
-					score-=1;
-					break;
-
-				}
-			}
-
-
-
-		}
-		if(flaggreen[i]==0)
-		{
-			if((-0.1+changegreen[i]<=-3.2))
-			{
-				if( ((-0.6f+2.0f-move2<=-0.1+xgreen[i]) and (-0.1+xgreen[i]<=0.6f+2.0f-move2)) or ((-0.6f+2.0f-move2<=0.1+xgreen[i]) and (0.1+xgreen[i]<=0.6f+2.0f-move2)))
-
-				{
-					flaggreen[i]=1;
-					score+=4;
-					break;
-
-				}
-			}
-
-
-
-		}
-
-
-	}
-
-
-
-	//bucket2
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translatebucket2 = glm::translate (glm::vec3(2.0f-move2, -3.6f, 0.0f));        // glTranslatef
-	Matrices.model *= (translatebucket2);
-	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	draw3DObject(bucket2);
-
-	//Draw red,black & green blocks;
-	for(i=1;i<=countred;i++)
-	{
-		if(flagred[i]==0)
-		{
-
-			Matrices.model = glm::mat4(1.0f);
-
-			/* Render your scene */
-			glm::mat4 translateRed = glm::translate (glm::vec3(xred[i], changered[i], 0.0f)); // glTranslatef
-			Matrices.model *= translateRed;
-			MVP = VP * Matrices.model; // MVP = p * V * M
-
-			//  Don't change unless you are sure!!
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// draw3DObject draws the VAO given to it using current MVP matrix
-			draw3DObject(red_block);
-		}
-	}
-	for(i=1;i<=countgreen;i++)
-	{
-		if(flaggreen[i]==0)
-		{
-			Matrices.model = glm::mat4(1.0f);
-
-			/* Render your scene */
-			glm::mat4 translateGreen = glm::translate (glm::vec3(xgreen[i], changegreen[i], 0.0f)); // glTranslatef
-			Matrices.model *= translateGreen;
-			MVP = VP * Matrices.model; // MVP = p * V * M
-
-			//  Don't change unless you are sure!!
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// draw3DObject draws the VAO given to it using current MVP matrix
-			draw3DObject(green_block);
-		}
-	}
-	for(i=1;i<=countblack;i++)
-	{
-		if(flagblack[i]==0)
-		{
-			Matrices.model = glm::mat4(1.0f);
-
-			/* Render your scene */
-			glm::mat4 translateBlack = glm::translate (glm::vec3(xblack[i], changeblack[i], 0.0f)); // glTranslatef
-			Matrices.model *= translateBlack;
-			MVP = VP * Matrices.model; // MVP = p * V * M
-
-			//  Don't change unless you are sure!!
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// draw3DObject draws the VAO given to it using current MVP matrix
-			draw3DObject(black_block);
-		}
-	}
-
-	///Draw Gun1;
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translate1gun1 = glm::translate (glm::vec3(3.75f, 0.0f, 0.0f));        // glTranslatef
-	glm::mat4 translate2gun1 = glm::translate (glm::vec3(-3.75f, change, 0.0f));        // glTranslatef
-	glm::mat4 rotategun1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= (translate2gun1*rotategun1*translate1gun1);
-	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	draw3DObject(gun1);
-
-	//Draw gun2;
-	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translate1gun2 = glm::translate (glm::vec3(3.75f, 0.0f, 0.0f));        // glTranslatef
-	glm::mat4 translate2gun2 = glm::translate (glm::vec3(-3.75f, change, 0.0f));        // glTranslatef
-	glm::mat4 rotategun2 = glm::rotate((float)(rotation_angle*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-	Matrices.model *= (translate2gun2*rotategun2*translate1gun2);
-	MVP = VP * Matrices.model;
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	draw3DObject(gun2);
-	//Draw rendered scene of bullet;
-	for(i=1;i<=countBullet;i++)
+	// Objects only send their position and rotation, see meshTransform
+	ProfileTimer timer(PROF_DRAW_SCENE);
+	// the mirror mesh is 0.8 long, stretched to each mirror's length
+	for(i=0;i<(int)game.mirrors.size();i++)
+		submitMesh(LAYER_WORLD, mirror, meshTransform(game.mirrors[i].cx, game.mirrors[i].cy, game.mirrors[i].angle), sky_blue, game.mirrors[i].half/0.4f, 1);
+	for(i=0;i<(int)game.buckets.size();i++)
+		submitMesh(LAYER_WORLD, bucket, meshTransform(bucketX(game.buckets[i]), game.buckets[i].y, 0), blockColours[game.buckets[i].colour]);
+
+	timer.lap(PROF_DRAW_BLOCKS);
+	//Draw red,black & green blocks in one instanced call;
+	for(i=0;i<game.blocks.count;i++)
 	{
-
-		if(flagbullet[i]==0)
-		{
-
-			Matrices.model = glm::mat4(1.0f);
-
-			glm::mat4 translatebullet3 = glm::translate (glm::vec3(bulletx[i], bullety[i], 0.0f));        // glTranslatef
-			glm::mat4 translatebullet2 = glm::translate (glm::vec3(-3.75f, adjusty[i], 0.0f));        // glTranslatef
-			glm::mat4 translatebullet1 = glm::translate (glm::vec3(3.45f, 0.0f, 0.0f));        // glTranslatef
-			glm::mat4 rotatebullet = glm::rotate((float)(rotationBullet[i]*M_PI/180.0f), glm::vec3(0,0,1)); // rotate about vector (-1,1,1)
-			Matrices.model *= (translatebullet3*translatebullet2*rotatebullet*translatebullet1);
-			MVP = VP * Matrices.model;
-			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			draw3DObject(bullet);
-		}
+		const GLfloat* c = blockColours[game.blocks.colour[i]];
+		float y = game.blocks.py[i]+(game.blocks.y[i]-game.blocks.py[i])*render_alpha;
+		pushInstance(blocks, game.blocks.x[i], y, c[0], c[1], c[2]);
 	}
-	///check colision btw bullet and block
-	for(i=1;i<=countBullet;i++)
+	submitInstanceBatch(LAYER_BLOCKS, blocks);
+
+	timer.lap(PROF_DRAW_BULLETS);
+	// both parts of the gun turn about the barrel's base, at x=-3.75 in
+	// the meshes and at gunX on the playfield
+	submitMesh(LAYER_GUN, gun1, meshTransform(game.gunX, game.change, 0, -3.75f, 0), blue);
+	submitMesh(LAYER_GUN, gun2, meshTransform(game.gunX, game.change, game.rotation_angle, -3.75f, 0), blue);
+	// a bullet's mesh is centred on x=-3.45, turned about that centre
+	for(i=0;i<game.bullets.count;i++)
 	{
-		cx=-3.45+bulletx[i];
-		cy=adjusty[i]+bullety[i];
-		w=0.01;
-		if(flagbullet[i]==0)
-		{
-			for(j=1;j<=countblack;j++)
-			{
-				if(flagblack[i]==0)
-				{
-					bx=xblack[j];
-					by=changeblack[j];
-					bw=0.2;
-					if((abs(bx-cx)<=bw) && (abs(by-cy)<=bw))
-					{
-						flagbullet[i]=1;
-						flagblack[j]=1;
-						//perfect shoot
-						score+=2;
-						break;
-
-					}
-
-
-
-				}
-			}
-		}
-		if(flagbullet[i]==0)
-		{
-			for(j=1;j<=countred;j++)
-			{
-				if(flagred[i]==0)
-				{
-					bx=xred[j];
-					by=changered[j];
-					bw=0.2;
-					if((abs(bx-cx)<=bw) && (abs(by-cy)<=bw))
-					{
-						flagbullet[i]=1;
-						flagred[j]=1;
-						score-=1;
-						break;
-					}
-				}
-
-
-
-			}
-		}
-		if(flagbullet[i]==0)
-		{
-			for(j=1;j<=countgreen;j++)
-			{
-				if(flaggreen[i]==0)
-				{
-					bx=xgreen[j];
-					by=changegreen[j];
-					bw=0.2;
-					if((abs(bx-cx)<=bw) && (abs(by-cy)<=bw))
-					{
-						flagbullet[i]=1;
-						flaggreen[j]=1;
-						score-=1;
-						break;
-
-					}
-				}
-
-
-
-			}
-		}
-
+		float x = game.bullets.px[i]+(game.bullets.x[i]-game.bullets.px[i])*render_alpha;
+		float y = game.bullets.py[i]+(game.bullets.y[i]-game.bullets.py[i])*render_alpha;
+		submitMesh(LAYER_BULLETS, bullet, meshTransform(x+game.gunX, y+game.bullets.adjusty[i], game.bullets.rotation[i], -3.45f, 0), grey);
 	}
+	timer.lap(PROF_DRAW_FLUSH);
+	setCamera(VP);
+	flushRenderQueue();
+	timer.lap(PROF_DRAW_PARTICLES);
+	drawSparks(frames.reading().Particles);
+	timer.lap(-1);
+	if(profile_overlay)
+		drawProfileOverlay();
+	timer.lap(PROF_DRAW_HUD);
+	drawHud(game);
+	timer.lap(-1);
+	if(gpu_timing)
+		endGPUTimer();
 
 	// Swap the frame buffers
-	glutSwapBuffers ();
+	timer.lap(PROF_SWAP);
+	if(offscreen)
+		offscreenPresent();
+	else
+		glutSwapBuffers ();
+	timer.lap(-1);
+	inputPresented();
+	if(!startup_reported)
+		startupReport();
+	profileTick();
 	// Increment angles
 	float increments = 1;
 	//camera_rotation_angle++; // Simulating camera rotation
@@ -1368,36 +1463,28 @@ void draw ()
 	rectangle_rotation = rectangle_rotation + increments*rectangle_rot_dir*rectangle_rot_status;
 }
 /* Executed when the program is idle (no I/O activity) */
+/* Asks for a redraw whenever the simulation has published a new step */
 void idle ()
 {
-	// OpenGL should never stop drawing
-	// can draw the same scene or a modified scene
-	int i;
-	t++;
-	for(i=1;i<=countred;i++)
-		changered[i]-=speed;
-
-	for(i=1;i<=countgreen;i++)
-		changegreen[i]-=speed;
-	for(i=1;i<=countblack;i++)
-		changeblack[i]-=speed;
-	for(i=1;i<=countBullet;i++)
+	applyShaderReloads();
+	FrameState& frame=frames.reading();
+	// once the game over burst has faded
+	if(frame.Game.game_over && frame.Particles.count==0)
 	{
-		bullety[i]+=0.1*sin((rotationBullet[i]*M_PI)/180.0f);
-		bulletx[i]+=0.1*cos((rotationBullet[i]*M_PI)/180.0f);
+		cout<<"Game Over"<<endl;
+		cout<<"Total score:"<<frame.Game.score<<endl;
+		audioWaitIdle(1500);
+		quitGame(0);
 	}
-	if(t%50==0)
+	// nothing new since the last frame : sleep until the next step is due
+	// rather than spinning a core on glutIdleFunc
+	if(!frames.fresh())
 	{
-		i=(rand())%3;
-		if(i==0)
-			countred++;
-		else if(i==1)
-			countgreen++;
-		else if(i==2)
-			countblack++;
+		unsigned long long step_ns=1000000000ULL/SIM_HZ, due=frame.TickTime+step_ns, now=profileNow();
+		usleep(due>now ? min(due-now, step_ns)/1000+1 : 500);
+		return;
 	}
-
-	draw (); // drawing same scene
+	glutPostRedisplay ();
 }
 /* Initialise glut window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
@@ -1418,7 +1505,7 @@ void initGLUT (int& argc, char** argv, int width, int height)
 	GLenum err = glewInit();
 	if (err != GLEW_OK) {
 		cout << "Error: Failed to initialise GLEW : "<< glewGetErrorString(err) << endl;
-		exit (1);
+		quitGame(1);
 	}
 
 	// register glut callbacks
@@ -1446,7 +1533,7 @@ void menu(int op)
 	{
 		case 'Q':
 		case 'q':
-			exit(0);
+			quitGame(0);
 	}
 }
 
@@ -1469,14 +1556,26 @@ void addGLUTMenus ()
 /* Add all the models to be created here */
 void initGL (int width, int height)
 {
-	// Create the models
-	createbucket1(); // Generate the VAO, VBOs, vertices data & copy into the array buffer
+	// Create the models, all in one vertex buffer
+	createBucket();
 	createGun1();
 	createGun2();
-	// Create and compile our GLSL program from the shaders
+	createBlock();
+	createMirror();
+	createBullet();
+	createProfileBar();
+	uploadMeshes();
+	startupLap("gl_setup");
+	// Create and compile our GLSL program from the shaders, or load it
+	// from the shader cache
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	startupLap("shaders");
+	// Get a handle for our per-object uniforms; VP comes from the camera
+	TransformID = glGetUniformLocation(programID, "objectTransform");
+	ScaleID = glGetUniformLocation(programID, "objectScale");
+	ColorID = glGetUniformLocation(programID, "objectColor");
+	createCamera();
+	useCamera(programID);
 
 
 	reshapeWindow (width, height);
@@ -1487,66 +1586,182 @@ void initGL (int width, int height)
 
 	glEnable (GL_DEPTH_TEST);
 	glDepthFunc (GL_LEQUAL);
-	createred_block();
-	creategreen_block();
-	createblack_block();
-	createbucket2 ();
-	createmirror1();
-	createmirror2();
-	createmirror3();
-	createmirror4();
-	createBullet();
+
+	// All blocks share one mesh; colour and position come per instance
+	startupLap("gl_setup");
+	instancedProgramID = LoadShaders( "Sample_GL_instanced.vert", "Sample_GL.frag" );
+	textProgramID = LoadShaders( "Sample_GL_text.vert", "Sample_GL_text.frag" );
+	sparkProgramID = LoadShaders( "Sample_GL_text.vert", "Sample_GL_sparks.frag" );
+	startupLap("shaders");
+	if(!programID || !instancedProgramID || !textProgramID || !sparkProgramID)
+	{
+		cout<<"Cannot start without the shaders"<<endl;
+		quitGame(1);
+	}
+	useCamera(instancedProgramID);
+	blocks = createInstanceBatch(block, instancedProgramID);
+	useCamera(textProgramID);
+	createHud();
+	useCamera(sparkProgramID);
+	createSparks();
+
+	glGenQueries(GPU_QUERIES, gpuQueries);
+
 	cout << "VENDOR: " << glGetString(GL_VENDOR) << endl;
 	cout << "RENDERER: " << glGetString(GL_RENDERER) << endl;
 	cout << "VERSION: " << glGetString(GL_VERSION) << endl;
 	cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+	startupLap("gl_setup");
+}
+
+/* --offscreen : draw 'count' frames into the offscreen framebuffer
+   (offscreen.h) as fast as they render, stepping the simulation once per
+   frame on this thread rather than on the clock, so a seed always gives
+   the same frames. Prints frame time statistics; with 'hash_path' also
+   writes every frame's hash there, one line per frame, and with
+   'dump_dir' every frame as a PPM image */
+void runOffscreen (int count, const char* hash_path, const char* dump_dir, int width, int height)
+{
+	FILE* hashes=NULL;
+	if(hash_path && (hashes=fopen(hash_path,"w"))==NULL)
+		cout<<"Cannot write "<<hash_path<<endl;
+	if(dump_dir)
+		mkdir(dump_dir, 0755);
+	std::vector<unsigned long long> times;
+	unsigned long long all=FNV_OFFSET, total=0;
+	for(int n=0;n<count;n++)
+	{
+		simStep();
+		unsigned long long start=profileNow();
+		draw();
+		times.push_back(profileNow()-start);
+		total+=times.back();
+		if(hashes)
+		{
+			unsigned long long hash=offscreenHash();
+			fprintf(hashes, "%d %016llx\n", n, hash);
+			all=fnv1a(&hash, sizeof hash, all);
+		}
+		if(dump_dir)
+		{
+			char path[512];
+			snprintf(path, sizeof path, "%s/frame_%05d.ppm", dump_dir, n);
+			offscreenDump(path);
+		}
+	}
+	if(hashes)
+		fclose(hashes);
+	if(times.empty())
+		return;
+	sort(times.begin(), times.end());
+	printf("offscreen %dx%d frames %d mean-ms %.3f p50-ms %.3f p99-ms %.3f max-ms %.3f fps %.1f\n",
+		width, height, count, total/1e6/count, times[count/2]/1e6, times[count*99/100]/1e6, times.back()/1e6, count/(total/1e9));
+	if(hashes)
+		printf("frames-hash %016llx\n", all);
 }
 
 int main (int argc, char** argv)
 
 {
 
-    /* initializations */
-    ao_initialize();
-    driver = ao_default_driver_id();
-    mpg123_init();
-    mh = mpg123_new(NULL, &err);
-    buffer_size = mpg123_outblock(mh);
-    buffer = (unsigned char*) malloc(buffer_size * sizeof(unsigned char));
-    string s="./example.mp3";
-    /* open the file and get the decoding format */
-    mpg123_open(mh,&s[0]);
-    mpg123_getformat(mh, &rate, &channels, &encoding);
-
-    /* set the output format and open the output device */
-    format.bits = mpg123_encsize(encoding) * BITS;
-    format.rate = rate;
-    format.channels = channels;
-    format.byte_format = AO_FMT_NATIVE;
-    format.matrix = 0;
-    dev = ao_open_live(driver, &format, NULL);
-
-	pthread_t mythread;
-        pthread_create(&mythread, NULL, playsound,(void*)NULL);
-	initialise();
+	startup_origin=startup_last=profileNow();
+	// --record FILE logs the seed and every input for bit-exact replay
+	// (./headless --replay FILE)
+	unsigned int seed=time(NULL);
+	bool seeded=false;
+	const char* record_path=NULL;
 	int width = 800;
-
 	int height = 600;
+	int offscreen_frames=600;
+	const char* hash_path=NULL;
+	const char* dump_dir=NULL;
+	for(int i=1;i<argc;i++)
+	{
+		if(!strcmp(argv[i],"--record") && i+1<argc)
+			record_path=argv[++i];
+		// --profile FILE streams per-second phase timings as CSV
+		else if(!strcmp(argv[i],"--profile") && i+1<argc)
+			profile_csv=profileOpenCSV(argv[++i]);
+		// --level FILE plays another level than levels/default.txt
+		else if(!strcmp(argv[i],"--level") && i+1<argc)
+			level_path=argv[++i];
+		// --offscreen WxH renders without a window : see runOffscreen(),
+		// with --frames N, --hashes FILE, --dump DIR and --seed N
+		else if(!strcmp(argv[i],"--offscreen"))
+		{
+			// a run meant to be headless must not fall back to a window
+			char end;
+			if(i+1>=argc || sscanf(argv[i+1],"%dx%d%c",&width,&height,&end)!=2 || width<=0 || height<=0)
+			{
+				fprintf(stderr, "usage: %s --offscreen WIDTHxHEIGHT [--frames N] [--hashes FILE] [--dump DIR] [--seed N]\n", argv[0]);
+				return 1;
+			}
+			offscreen=true;
+			i++;
+		}
+		else if(!strcmp(argv[i],"--frames") && i+1<argc)
+			offscreen_frames=atoi(argv[++i]);
+		else if(!strcmp(argv[i],"--hashes") && i+1<argc)
+			hash_path=argv[++i];
+		else if(!strcmp(argv[i],"--dump") && i+1<argc)
+			dump_dir=argv[++i];
+		else if(!strcmp(argv[i],"--seed") && i+1<argc)
+		{
+			seed=strtoul(argv[++i],NULL,10);
+			seeded=true;
+		}
+	}
+	// the same frames every run unless asked otherwise
+	if(offscreen && !seeded)
+		seed=1;
+	// no sound offscreen : build hosts have no audio device either
+	if(!offscreen)
+	{
+		audioStart("./example.mp3");
+		startupLap("audio");
+	}
+	profile_enabled=profile_csv;
+	loadLevel();
+	initialise(seed);
+	inputQueue.init(INPUT_QUEUE);
+	startupLap("level");
+	if(record_path && startRecording(record_path,seed))
+	{
+		recording=true;
+		atexit(endRecording);
+	}
+	if(offscreen)
+	{
+		if(!offscreenStart(width, height))
+			quitGame(1);
+		startupLap("context");
+		initGL (width, height);
+		runOffscreen(offscreen_frames, hash_path, dump_dir, width, height);
+		offscreenStop();
+		quitGame(0);
+	}
 
 	initGLUT (argc, argv, width, height);
-	last_update_time=glutGet(GLUT_ELAPSED_TIME);
+	startupLap("window");
 
 	addGLUTMenus ();
 
 	initGL (width, height);
 
+	// hot reloading of the shaders, the level and the sound effects
+	std::string level_dir=level_path;
+	size_t slash=level_dir.rfind('/');
+	level_dir=slash==std::string::npos ? "." : level_dir.substr(0,slash);
+	const char* watched[] = { ".", "sfx", level_dir.c_str() };
+	levelReloads.init(4);
+	shaderReloads.init(16);
+	watchStart(watched, 3, assetChanged);
+
+	simStart();
 	glutMainLoop ();
-free(buffer);
-    ao_close(dev);
-    mpg123_close(mh);
-    mpg123_delete(mh);
-    mpg123_exit();
-    ao_shutdown();
+	simStop();
+	watchStop();
+	audioStop();
 
 	return 0;
 }
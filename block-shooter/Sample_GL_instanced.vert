@@ -0,0 +1,27 @@
+#version 330 core
+
+// input data : sent from main program
+layout (location = 0) in vec3 vertexPosition;
+// per-instance data : advanced once per instance (glVertexAttribDivisor 1)
+layout (location = 1) in vec3 instanceColor;
+layout (location = 2) in vec2 instanceOffset;
+
+// shared by every program, uploaded once per frame
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    // Every instance shares the same mesh, only translated in the XY plane
+    vec4 v = vec4(vertexPosition.xy + instanceOffset, vertexPosition.z, 1);
+
+    // Whole instance is drawn in a single colour
+    fragColor = instanceColor;
+
+    // Output position of the vertex, in clip space : VP * (offset + position)
+    gl_Position = VP * v;
+}
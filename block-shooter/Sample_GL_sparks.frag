@@ -0,0 +1,19 @@
+#version 330 core
+
+// Interpolated values from the vertex shader
+in vec2 texCoord;
+in vec3 fragColor;
+
+// the particle image (particles.h) : painted texels have alpha 1
+uniform sampler2D particleImage;
+
+// output data
+out vec3 color;
+
+void main()
+{
+    vec4 texel = texture(particleImage, texCoord);
+    if (texel.a < 0.5)
+        discard;
+    color = texel.rgb;
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+// Interpolated values from the vertex shader
+in vec2 texCoord;
+in vec3 fragColor;
+
+// the font atlas : glyph pixels are 1, the rest 0
+uniform sampler2D glyphAtlas;
+
+// output data
+out vec3 color;
+
+void main()
+{
+    // only the glyph's own pixels are drawn
+    if (texture(glyphAtlas, texCoord).r < 0.5)
+        discard;
+    color = fragColor;
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// input data : one vertex of a glyph quad in window pixels, or of the
+// particle image's quad in world units
+layout (location = 0) in vec2 vertexPosition;
+layout (location = 1) in vec2 vertexTexCoord;
+layout (location = 2) in vec3 vertexColor;
+
+// shared by every program; the HUD sets it to window pixels
+layout (std140) uniform Camera {
+    mat4 VP;
+};
+
+// output data : used by fragment shader
+out vec2 texCoord;
+out vec3 fragColor;
+
+void main ()
+{
+    texCoord = vertexTexCoord;
+    fragColor = vertexColor;
+    gl_Position = VP * vec4(vertexPosition, 0, 1);
+}
@@ -0,0 +1,106 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include "asset_watch.h"
+
+using namespace std;
+
+static int inotify_fd = -1;
+static int wake_pipe[2] = { -1, -1 };  // written by watchStop() to end the wait
+static pthread_t watch_thread;
+static WatchHandler watch_handler;
+static int watch_ids[WATCH_MAX_DIRS];
+static string watch_dirs[WATCH_MAX_DIRS];
+static int watch_count = 0;
+
+static bool ignored (const char* name)
+{
+	size_t n = strlen(name);
+	return name[0] == '.' || name[n-1] == '~' || (n > 4 && !strcmp(name+n-4, ".tmp"));
+}
+
+static void* watchLoop (void*)
+{
+	// aligned for the inotify_event records read into it
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 } };
+	while (1) {
+		if (poll(fds, 2, -1) < 0)
+			continue;
+		if (fds[1].revents)
+			break;
+		ssize_t length = read(inotify_fd, buffer, sizeof buffer);
+		for (char* p = buffer; p < buffer+length; ) {
+			const struct inotify_event* e = (const struct inotify_event*)p;
+			p += sizeof *e + e->len;
+			if (e->len == 0 || ignored(e->name))
+				continue;
+			for (int i=0; i<watch_count; i++)
+				if (watch_ids[i] == e->wd) {
+					string path = watch_dirs[i] == "." ? e->name : watch_dirs[i] + "/" + e->name;
+					watch_handler(path.c_str());
+				}
+		}
+	}
+	return NULL;
+}
+
+bool watchStart (const char* const* dirs, int count, WatchHandler handler)
+{
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (inotify_fd < 0 || pipe(wake_pipe) != 0) {
+		fprintf(stderr, "Cannot watch assets, hot reloading is off\n");
+		watchStop();
+		return false;
+	}
+	for (int i=0; i<count && watch_count<WATCH_MAX_DIRS; i++) {
+		int id = inotify_add_watch(inotify_fd, dirs[i], IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (id < 0)
+			continue;
+		// the same directory twice gives the same id
+		bool known = false;
+		for (int j=0; j<watch_count; j++)
+			known = known || watch_ids[j] == id;
+		if (known)
+			continue;
+		watch_ids[watch_count] = id;
+		watch_dirs[watch_count] = dirs[i];
+		watch_count++;
+	}
+	watch_handler = handler;
+	pthread_create(&watch_thread, NULL, watchLoop, NULL);
+	return true;
+}
+
+void watchStop ()
+{
+	if (wake_pipe[1] >= 0 && inotify_fd >= 0 && watch_handler) {
+		ssize_t woken;
+		do
+			woken = write(wake_pipe[1], "", 1);
+		while (woken < 0 && errno == EINTR);
+		if (woken != 1) {
+			// the thread would never see the wake, and joining it would
+			// hang : leave it waiting, with its descriptors and handler
+			fprintf(stderr, "Cannot stop watching assets\n");
+			pthread_detach(watch_thread);
+			return;
+		}
+		pthread_join(watch_thread, NULL);
+		watch_handler = NULL;
+	}
+	for (int i=0; i<2; i++) {
+		if (wake_pipe[i] >= 0)
+			close(wake_pipe[i]);
+		wake_pipe[i] = -1;
+	}
+	if (inotify_fd >= 0)
+		close(inotify_fd);
+	inotify_fd = -1;
+	watch_count = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef ASSET_WATCH_H
+#define ASSET_WATCH_H
+
+/* Asset watcher : a thread blocked on inotify that calls a handler with
+   the path of every file written in the watched directories (closed
+   after writing, or renamed into place as editors and our own caches
+   do). Paths are "dir/name", or just "name" for ".". Temporary and hidden
+   files are skipped. The handler runs on the watcher thread, so it can do
+   slow work (decoding, compiling) away from the render thread, and must
+   hand anything else over itself. Linux only; elsewhere, or without
+   inotify, nothing is watched. */
+
+#define WATCH_MAX_DIRS 8
+
+typedef void (*WatchHandler) (const char* path);
+
+/* Watch the directories (duplicates and missing ones are skipped) and
+   start the thread. False if inotify is unavailable */
+bool watchStart (const char* const* dirs, int count, WatchHandler handler);
+
+/* Stop the thread; the handler is not called any more once this returns.
+   Should the thread not be woken (reported), it is left running rather
+   than waited for. Safe to call when watchStart() failed or was never
+   called */
+void watchStop ();
+
+#endif
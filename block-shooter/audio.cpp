@@ -0,0 +1,302 @@
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+#include <pthread.h>
+#include <ao/ao.h>
+#include <mpg123.h>
+#include "audio.h"
+#include "spsc_queue.h"
+#include "pcm_cache.h"
+#include "mixer.h"
+
+using namespace std;
+
+#define AUDIO_RING_SECONDS 0.5  // decoded audio buffered ahead of the device
+#define AUDIO_PERIOD_FRAMES 256 // frames mixed and handed to ao_play at once
+#define AUDIO_BACKOFF_US 5000   // sleep of the decoder when the ring is full
+#define AUDIO_DEFAULT_RATE 44100 // device format when there is no music
+#define AUDIO_DEFAULT_CHANNELS 2
+
+static mpg123_handle *mh = NULL;
+static ao_device *dev = NULL;
+static int channels;
+static long rate;
+
+static PCMAsset music;       // cached decode, when it could be mapped
+static bool streaming = false; // no cache : decode on the fly into 'pcm'
+static SPSCQueue<short> pcm;
+static pthread_t decoder_thread, output_thread;
+static atomic<bool> audio_running(false);
+static bool libraries_up = false;
+
+static vector<short> synthesized[SFX_COUNT];
+static PCMAsset sfx_files[SFX_COUNT];
+static int sfx_ids[SFX_COUNT];
+static vector<PCMAsset> retired_sfx; // replaced, maybe still playing until audioStop()
+static const char* sfx_names[SFX_COUNT] = { "shot", "bounce", "hit", "catch", "wrong_bucket", "game_over" };
+
+/* Decode ahead into the ring, rewinding at the end of the file */
+static void* decodeLoop (void*)
+{
+	vector<short> chunk(mpg123_outblock(mh)/sizeof(short));
+	size_t pending = 0, offset = 0; // decoded samples not yet in the ring
+	bool rewound = false;           // guards against an empty file
+
+	while (audio_running.load()) {
+		if (pending == 0) {
+			size_t done = 0;
+			int err = mpg123_read(mh, &chunk[0], chunk.size()*sizeof(short), &done);
+			if (err == MPG123_DONE && done == 0) {
+				if (rewound)
+					break;
+				mpg123_seek(mh, 0, SEEK_SET);
+				rewound = true;
+				continue;
+			}
+			if (err != MPG123_OK && err != MPG123_DONE && err != MPG123_NEW_FORMAT) {
+				fprintf(stderr, "Audio decode failed: %s\n", mpg123_strerror(mh));
+				break;
+			}
+			rewound = false;
+			pending = done/sizeof(short);
+			offset = 0;
+		}
+		size_t pushed = pcm.push(&chunk[offset], pending);
+		offset += pushed;
+		pending -= pushed;
+		if (pending)
+			usleep(AUDIO_BACKOFF_US); // ring full, the device is behind us
+	}
+	return NULL;
+}
+
+/* One period of music : the next frames of the mapped track, or of the
+   ring when streaming (silence where the decoder has fallen behind), or
+   NULL when there is no music. 'frames' may come back shorter at the end
+   of the mapped track */
+static const short* nextMusic (vector<short>& period, size_t& pos, size_t& frames)
+{
+	if (music.samples) {
+		if (frames > music.frames - pos)
+			frames = music.frames - pos;
+		const short* samples = music.samples + pos*channels;
+		pos += frames;
+		if (pos == music.frames)
+			pos = 0;
+		return samples;
+	}
+	if (streaming) {
+		size_t want = pcm.size();
+		if (want > frames*channels)
+			want = frames*channels;
+		want -= want % channels;
+		size_t got = pcm.pop(&period[0], want);
+		fill(period.begin()+got, period.begin()+frames*channels, 0);
+		return &period[0];
+	}
+	return NULL;
+}
+
+/* Mix music and sound effects one short period at a time; ao_play blocks
+   at the device's pace. Everything is allocated before the loop */
+static void* outputLoop (void*)
+{
+	vector<short> period(AUDIO_PERIOD_FRAMES*channels), out(AUDIO_PERIOD_FRAMES*channels);
+	size_t pos = 0; // next frame of the mapped track
+	while (audio_running.load()) {
+		size_t frames = AUDIO_PERIOD_FRAMES;
+		const short* samples = nextMusic(period, pos, frames);
+		mixerRender(samples, &out[0], frames);
+		ao_play(dev, (char*)&out[0], frames*channels*sizeof(short));
+	}
+	return NULL;
+}
+
+/* Open 'path' for decoding on the fly, when it cannot be cached */
+static bool openStream (const char* path)
+{
+	int err, encoding;
+	mh = mpg123_new(NULL, &err);
+	if (mh == NULL || mpg123_open(mh, path) != MPG123_OK || mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK)
+		return false;
+	// Always decode to signed 16 bit, keeping the file's rate and channels
+	mpg123_format_none(mh);
+	mpg123_format(mh, rate, channels, MPG123_ENC_SIGNED_16);
+	return true;
+}
+
+/* A mono chirp from f0 to f1 Hz with some noise mixed in, fading out
+   exponentially. Enough for the game's effects without shipping assets */
+static void synthesize (vector<short>& out, float seconds, float f0, float f1, float noise, float amplitude)
+{
+	unsigned int seed = 22222;
+	size_t frames = seconds*rate;
+	size_t attack = rate/500; // 2 ms fade in, against clicks
+	double phase = 0;
+	out.resize(frames);
+	for (size_t i=0; i<frames; i++) {
+		float x = (float)i/frames;
+		phase += 2*M_PI*(f0 + (f1-f0)*x)/rate;
+		seed = seed*1103515245 + 12345;
+		float n = ((seed >> 16) & 0x7FFF)/16384.0f - 1;
+		float s = (1-noise)*sin(phase) + noise*n;
+		float envelope = exp(-4*x) * (i < attack ? (float)i/attack : 1);
+		out[i] = 32767*amplitude*envelope*s;
+	}
+}
+
+/* Sound effects come from sfx/<name>.mp3 through the PCM cache when such
+   a file exists and matches the device, and are synthesized otherwise */
+static void loadEffects ()
+{
+	synthesize(synthesized[SFX_SHOT], 0.08, 900, 300, 0.3, 0.35);
+	synthesize(synthesized[SFX_BOUNCE], 0.05, 2000, 1800, 0, 0.25);
+	synthesize(synthesized[SFX_HIT], 0.12, 200, 80, 0.7, 0.5);
+	synthesize(synthesized[SFX_CATCH], 0.15, 660, 990, 0, 0.4);
+	synthesize(synthesized[SFX_WRONG_BUCKET], 0.25, 220, 150, 0.1, 0.4);
+	synthesize(synthesized[SFX_GAME_OVER], 0.9, 440, 110, 0.1, 0.6);
+
+	for (int i=0; i<SFX_COUNT; i++) {
+		MixerSound sound;
+		char path[256];
+		snprintf(path, sizeof path, "sfx/%s.mp3", sfx_names[i]);
+		if (access(path, R_OK) == 0 && pcmCacheLoad(path, sfx_files[i])
+				&& sfx_files[i].rate == rate && (sfx_files[i].channels == 1 || sfx_files[i].channels == channels)) {
+			sound.samples = sfx_files[i].samples;
+			sound.frames = sfx_files[i].frames;
+			sound.channels = sfx_files[i].channels;
+		}
+		else {
+			pcmCacheRelease(sfx_files[i]);
+			sound.samples = &synthesized[i][0];
+			sound.frames = synthesized[i].size();
+			sound.channels = 1;
+		}
+		sound.gain = 32767;
+		sfx_ids[i] = mixerAddSound(sound);
+	}
+}
+
+bool audioStart (const char* path)
+{
+	ao_initialize();
+	mpg123_init();
+	libraries_up = true;
+	if (pcmCacheLoad(path, music)) {
+		rate = music.rate;
+		channels = music.channels;
+	}
+	else if (openStream(path))
+		streaming = true;
+	else {
+		fprintf(stderr, "Cannot decode %s, playing without music\n", path);
+		rate = AUDIO_DEFAULT_RATE;
+		channels = AUDIO_DEFAULT_CHANNELS;
+	}
+
+	ao_sample_format format;
+	format.bits = 16;
+	format.rate = rate;
+	format.channels = channels;
+	format.byte_format = AO_FMT_NATIVE;
+	format.matrix = 0;
+	dev = ao_open_live(ao_default_driver_id(), &format, NULL);
+	if (dev == NULL) {
+		fprintf(stderr, "Cannot open audio device, playing without sound\n");
+		audioStop();
+		return false;
+	}
+
+	mixerInit(channels, AUDIO_PERIOD_FRAMES);
+	loadEffects();
+	audio_running.store(true);
+	if (streaming) {
+		pcm.init(rate*channels*AUDIO_RING_SECONDS);
+		pthread_create(&decoder_thread, NULL, decodeLoop, NULL);
+	}
+	pthread_create(&output_thread, NULL, outputLoop, NULL);
+	return true;
+}
+
+void audioPlay (int sfx)
+{
+	if (audio_running.load())
+		mixerTrigger(sfx_ids[sfx]);
+}
+
+bool audioReloadEffect (const char* path)
+{
+	int i;
+	char name[256];
+	for (i=0; i<SFX_COUNT; i++) {
+		snprintf(name, sizeof name, "sfx/%s.mp3", sfx_names[i]);
+		if (!strcmp(path, name))
+			break;
+	}
+	if (i == SFX_COUNT)
+		return false;
+	if (!audio_running.load())
+		return true;
+	PCMAsset asset;
+	if (!pcmCacheLoad(path, asset))
+		return true;
+	if (asset.rate != rate || (asset.channels != 1 && asset.channels != channels)) {
+		fprintf(stderr, "%s does not match the output format, not reloaded\n", path);
+		pcmCacheRelease(asset);
+		return true;
+	}
+	MixerSound sound;
+	sound.samples = asset.samples;
+	sound.frames = asset.frames;
+	sound.channels = asset.channels;
+	sound.gain = 32767;
+	mixerReplaceSound(sfx_ids[i], sound);
+	if (sfx_files[i].map)
+		retired_sfx.push_back(sfx_files[i]);
+	sfx_files[i] = asset;
+	return true;
+}
+
+void audioWaitIdle (int timeout_ms)
+{
+	if (!audio_running.load())
+		return;
+	// give the output thread a couple of periods to start the last triggers
+	usleep(2*AUDIO_PERIOD_FRAMES*1000000LL/rate);
+	for (int waited=0; waited<timeout_ms && mixerActiveVoices()>0; waited+=10)
+		usleep(10000);
+}
+
+void audioStop ()
+{
+	if (audio_running.exchange(false)) {
+		if (streaming)
+			pthread_join(decoder_thread, NULL);
+		pthread_join(output_thread, NULL);
+	}
+	streaming = false;
+	pcmCacheRelease(music);
+	for (int i=0; i<SFX_COUNT; i++)
+		pcmCacheRelease(sfx_files[i]);
+	for (size_t i=0; i<retired_sfx.size(); i++)
+		pcmCacheRelease(retired_sfx[i]);
+	retired_sfx.clear();
+	if (dev) {
+		ao_close(dev);
+		dev = NULL;
+	}
+	if (mh) {
+		mpg123_close(mh);
+		mpg123_delete(mh);
+		mh = NULL;
+	}
+	if (libraries_up) {
+		mpg123_exit();
+		ao_shutdown();
+		libraries_up = false;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+/* Background music and sound effects. Normally the track is decoded once
+   into the PCM cache (pcm_cache.h) and the output thread loops over the
+   mapped samples. If the cache cannot be used, a decoder thread turns the
+   MP3 into 16-bit PCM and keeps a lock-free ring topped up, looping back
+   to the start at the end of the file, while the output thread drains the
+   ring. Every period the output thread lays the sound effects over the
+   music through the mixer (mixer.h). The libao device paces the output
+   thread; the decoder sleeps when the ring is full, and nothing spins. */
+
+/* Same order as GameEventType, so an event maps straight to its sound */
+enum SoundEffect { SFX_SHOT, SFX_BOUNCE, SFX_HIT, SFX_CATCH, SFX_WRONG_BUCKET, SFX_GAME_OVER, SFX_COUNT };
+
+/* Open the default output device and start playing 'path' in a loop.
+   Without the track only the sound effects play; returns false (and
+   leaves the game silent) if the device cannot be opened */
+bool audioStart (const char* path);
+
+/* Stop both threads and release the decoder and device. Safe to call
+   more than once, and when audioStart() failed */
+void audioStop ();
+
+/* Game thread : start a sound effect. Never blocks; heard within one
+   period (AUDIO_PERIOD_FRAMES) plus the device's own buffering */
+void audioPlay (int sfx);
+
+/* Reload the sound effect stored in 'path' if it is one (sfx/<name>.mp3),
+   for hot reloading; false for any other file. Decodes on the calling
+   thread; call from one thread only */
+bool audioReloadEffect (const char* path);
+
+/* Wait, up to 'timeout_ms', for the playing sound effects to finish */
+void audioWaitIdle (int timeout_ms);
+
+#endif
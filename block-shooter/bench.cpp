@@ -0,0 +1,410 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "entity_pool.h"
+#include "spatial_grid.h"
+#include "integrate.h"
+#include "particles.h"
+#include "game.h"
+#include "profiler.h"
+
+using namespace std;
+
+/* By default, the simulation kernels : each phase of simulate() from
+   game.cpp, the very code the game runs, timed alone on scenes of 10 to
+   100000 entities. A scene is built and the game state restored before
+   every run, outside the timing; a few warmup runs are thrown away, then
+   every run is one sample. Each kernel and entity count gives one line of
+   "key value" pairs : the spread of the samples, and the median per
+   entity in nanoseconds and in time stamp counter cycles (the TSC ticks
+   at a fixed rate, not at the core's current clock). The cost of reading
+   the clocks is measured first and taken off every sample.
+
+   With --compare, the older side by side runs. Bullet-vs-block collision:
+   the original all-pairs loop from draw() against the uniform grid broad
+   phase, on the same random scene. Then bullet integration : sin/cos of
+   the heading every tick, as the game did, against the cached per-tick
+   velocity, scalar and SIMD. Last, a full particle pool : its step,
+   scalar and SIMD, and the export of its instance data for drawing */
+
+#define HIT_RANGE 0.2f
+#define STEP 0.05f   // BULLET_SPEED*SIM_DT
+#define TICKS 100    // integration steps per timed run
+#define PARTICLES 50000
+
+float frand (float lo, float hi)
+{
+	return lo + (hi-lo)*(rand()/(float)RAND_MAX);
+}
+
+/* Random bullets and blocks spread over the playfield */
+void makeScene (BulletPool& bullets, BlockPool& blocks, int nbullets, int nblocks)
+{
+	srand(1);
+	for (int i=0; i<nblocks; i++)
+		spawnBlock(blocks, frand(-4, 4), frand(-4, 4), rand()%3);
+	for (int i=0; i<nbullets; i++) {
+		int b = spawnBullet(bullets, frand(-4, 4), frand(0, 360), STEP);
+		bullets.x[b] = frand(-0.5, 7.5);
+	}
+}
+
+/* All pairs, as draw() did it: every bullet scans every block */
+int collideBrute (BulletPool& bullets, BlockPool& blocks)
+{
+	int hits = 0;
+	for (int i=0; i<bullets.count; i++) {
+		float cx = -3.45+bullets.x[i], cy = bullets.adjusty[i]+bullets.y[i];
+		for (int j=0; j<blocks.count; j++) {
+			if (fabsf(blocks.x[j]-cx) <= HIT_RANGE && fabsf(blocks.y[j]-cy) <= HIT_RANGE) {
+				killBlock(blocks, j);
+				killBullet(bullets, i);
+				i--;
+				hits++;
+				break;
+			}
+		}
+	}
+	return hits;
+}
+
+/* Grid broad phase, as draw() does it now */
+int collideGrid (BulletPool& bullets, BlockPool& blocks, SpatialGrid& grid, vector<char>& hit)
+{
+	int hits = 0;
+	buildGrid(grid, blocks.x.data(), blocks.y.data(), blocks.count);
+	hit.assign(blocks.count, 0);
+	for (int i=0; i<bullets.count; i++) {
+		float cx = -3.45+bullets.x[i], cy = bullets.adjusty[i]+bullets.y[i];
+		int j = queryGrid(grid, blocks.x.data(), blocks.y.data(), hit, cx, cy, HIT_RANGE);
+		if (j < 0)
+			continue;
+		hit[j] = 1;
+		killBullet(bullets, i);
+		i--;
+		hits++;
+	}
+	for (int j=blocks.count-1; j>=0; j--)
+		if (hit[j])
+			killBlock(blocks, j);
+	return hits;
+}
+
+/* What simulate() did before velocities were cached */
+void integrateTrig (BulletPool& bullets)
+{
+	for (int i=0; i<bullets.count; i++) {
+		bullets.y[i] += STEP*sin((bullets.rotation[i]*M_PI)/180.0f);
+		bullets.x[i] += STEP*cos((bullets.rotation[i]*M_PI)/180.0f);
+	}
+}
+
+double msSince (chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void compareVariants (int nbullets, int nblocks)
+{
+	int reps = 5;
+
+	BulletPool bullets0;
+	BlockPool blocks0;
+	makeScene(bullets0, blocks0, nbullets, nblocks);
+
+	double brute = 1e30, grid = 1e30;
+	int bruteHits = 0, gridHits = 0;
+	SpatialGrid spatial;
+	vector<char> hit;
+	for (int r=0; r<reps; r++) {
+		BulletPool bullets = bullets0;
+		BlockPool blocks = blocks0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		bruteHits = collideBrute(bullets, blocks);
+		brute = min(brute, msSince(start));
+
+		bullets = bullets0;
+		blocks = blocks0;
+		start = chrono::steady_clock::now();
+		gridHits = collideGrid(bullets, blocks, spatial, hit);
+		grid = min(grid, msSince(start));
+	}
+
+	printf("bullets %d blocks %d (best of %d)\n", nbullets, nblocks, reps);
+	printf("all pairs : %10.3f ms  %d hits\n", brute, bruteHits);
+	printf("grid      : %10.3f ms  %d hits\n", grid, gridHits);
+	printf("speedup   : %10.1fx\n", brute/grid);
+
+	double trig = 1e30, scalar = 1e30, simd = 1e30;
+	for (int r=0; r<reps; r++) {
+		BulletPool bullets = bullets0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			integrateTrig(bullets);
+		trig = min(trig, msSince(start));
+
+		bullets = bullets0;
+		start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			integrateBulletsScalar(bullets.x.data(), bullets.y.data(), bullets.vx.data(), bullets.vy.data(), bullets.count);
+		scalar = min(scalar, msSince(start));
+
+		bullets = bullets0;
+		start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			integrateBullets(bullets.x.data(), bullets.y.data(), bullets.vx.data(), bullets.vy.data(), bullets.count);
+		simd = min(simd, msSince(start));
+	}
+	double per = 1e6/((double)TICKS*max(nbullets, 1)); // ms per run -> ns per bullet-tick
+	printf("\nbullet integration, %d ticks (best of %d)\n", TICKS, reps);
+	printf("sin/cos   : %10.3f ms  %6.2f ns/bullet\n", trig, trig*per);
+	printf("scalar    : %10.3f ms  %6.2f ns/bullet\n", scalar, scalar*per);
+	printf("simd      : %10.3f ms  %6.2f ns/bullet\n", simd, simd*per);
+
+	// long lived, so the pool stays full for every timed run
+	static ParticlePool particles0, particles;
+	static ParticleImage image;
+	static const float white[3] = { 1, 1, 1 }, black[3] = { 0, 0, 0 };
+	while (particles0.count < PARTICLES)
+		emitBurst(particles0, frand(-4, 4), frand(-4, 4), min(60, PARTICLES-particles0.count), 2.5f, 100.0f, black);
+	double pscalar = 1e30, psimd = 1e30, pstep = 1e30, psplat = 1e30;
+	for (int r=0; r<reps; r++) {
+		particles = particles0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			integrateParticlesScalar(particles.x, particles.y, particles.vx, particles.vy, particles.alpha, particles.fade, particles.count, 1e-4f);
+		pscalar = min(pscalar, msSince(start));
+
+		particles = particles0;
+		start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			integrateParticles(particles.x, particles.y, particles.vx, particles.vy, particles.alpha, particles.fade, particles.count, 1e-4f);
+		psimd = min(psimd, msSince(start));
+
+		particles = particles0;
+		start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			stepParticles(particles);
+		pstep = min(pstep, msSince(start));
+
+		start = chrono::steady_clock::now();
+		for (int k=0; k<TICKS; k++)
+			splatParticles(particles, image, white);
+		psplat = min(psplat, msSince(start));
+	}
+	per = 1e6/((double)TICKS*PARTICLES);
+	printf("\nparticles, %d live, %d ticks (best of %d)\n", PARTICLES, TICKS, reps);
+	printf("scalar    : %10.3f ms  %6.2f ns/particle\n", pscalar, pscalar*per);
+	printf("simd      : %10.3f ms  %6.2f ns/particle\n", psimd, psimd*per);
+	printf("step      : %10.3f ms  %6.2f ns/particle (simd + retiring)\n", pstep, pstep*per);
+	printf("splat     : %10.3f ms  %6.2f ns/particle\n", psplat, psplat*per);
+}
+
+/* Kernel scenes. Blocks and bullets are spread over the playfield of the
+   built-in level; what a kernel counts as its entities is in 'per' */
+static BlockPool sceneBlocks;
+static BulletPool sceneBullets;
+static int sceneCount;
+
+unsigned long long cyclesNow ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+void randomBlocks (int n, int colours)
+{
+	for (int i=0; i<n; i++)
+		spawnBlock(sceneBlocks, frand(-4, 4), frand(-3, 4.5), rand()%colours);
+}
+
+void randomBullets (int n)
+{
+	for (int i=0; i<n; i++) {
+		int b = spawnBullet(sceneBullets, frand(-4, 4), frand(0, 360), BULLET_SPEED*SIM_DT);
+		sceneBullets.x[b] = sceneBullets.px[b] = frand(-0.5, 7.5);
+		sceneBullets.y[b] = sceneBullets.py[b] = frand(-4, 4);
+	}
+}
+
+void sceneMove (int n)
+{
+	randomBlocks(n, 3);
+	randomBullets(n);
+}
+
+void sceneMirrors (int n)
+{
+	randomBullets(n);
+}
+
+/* Every block just above the catch line, red or green so none ends the
+   game; restore() drops them below it, so the run resolves them all */
+void sceneBuckets (int n)
+{
+	for (int i=0; i<n; i++)
+		spawnBlock(sceneBlocks, frand(-3, 3), -3.1f+frand(0.001f, 0.01f), rand()%2);
+}
+
+void sceneCollide (int n)
+{
+	randomBlocks(n, 3);
+	randomBullets(n);
+}
+
+/* n blocks already falling, queued for their catch lines as in play,
+   which the run then doubles */
+void sceneSpawn (int n)
+{
+	randomBlocks(n, 3);
+}
+
+void runSpawn ()
+{
+	for (int i=0; i<sceneCount; i++)
+		spawnNext();
+}
+
+void runBuckets ()
+{
+	scoreBuckets();
+}
+
+struct Kernel {
+	const char* name;
+	const char* per;         // what the entity count counts
+	int weight;              // entities per unit of the count
+	void (*scene) (int n);
+	void (*run) ();
+};
+
+static const Kernel kernels[] = {
+	{ "move",    "block+bullet", 2, sceneMove,    moveEntities },
+	{ "mirrors", "bullet",       1, sceneMirrors, reflectBullets },
+	{ "buckets", "block",        1, sceneBuckets, runBuckets },
+	{ "collide", "bullet",       1, sceneCollide, collideBullets },
+	{ "spawn",   "block",        1, sceneSpawn,   runSpawn },
+};
+#define KERNELS (int)(sizeof kernels/sizeof kernels[0])
+
+/* Put the scene back into the game, as if nothing had run */
+void restore (const Kernel& k)
+{
+	blockPool = sceneBlocks;
+	bulletPool = sceneBullets;
+	resetCatches();
+	gameEvents.clear();
+	if (k.run == runBuckets)
+		for (int i=0; i<blockPool.count; i++)
+			blockPool.y[i] -= 0.02f;
+}
+
+/* Median cost of reading both clocks, taken off every sample */
+void clockOverhead (double& ns, double& cycles)
+{
+	vector<double> a, b;
+	for (int i=0; i<1001; i++) {
+		unsigned long long t0 = profileNow(), c0 = cyclesNow();
+		unsigned long long c1 = cyclesNow(), t1 = profileNow();
+		a.push_back(t1-t0);
+		b.push_back(c1-c0);
+	}
+	sort(a.begin(), a.end());
+	sort(b.begin(), b.end());
+	ns = a[a.size()/2];
+	cycles = b[b.size()/2];
+}
+
+void runKernel (const Kernel& k, int n, int warmup, int reps, double overheadNs, double overheadCycles)
+{
+	resetGame(1);
+	sceneBlocks = BlockPool();
+	sceneBullets = BulletPool();
+	sceneCount = n;
+	srand(n);
+	k.scene(n);
+	vector<double> ns, cycles;
+	for (int r=-warmup; r<reps; r++) {
+		restore(k);
+		unsigned long long t0 = profileNow(), c0 = cyclesNow();
+		k.run();
+		unsigned long long c1 = cyclesNow(), t1 = profileNow();
+		if (r < 0)
+			continue;
+		ns.push_back(max(0.0, t1-t0-overheadNs));
+		cycles.push_back(max(0.0, c1-c0-overheadCycles));
+	}
+	double mean = 0, var = 0;
+	for (size_t i=0; i<ns.size(); i++)
+		mean += ns[i];
+	mean /= ns.size();
+	for (size_t i=0; i<ns.size(); i++)
+		var += (ns[i]-mean)*(ns[i]-mean);
+	double stddev = ns.size() > 1 ? sqrt(var/(ns.size()-1)) : 0;
+	sort(ns.begin(), ns.end());
+	sort(cycles.begin(), cycles.end());
+	double median = ns[ns.size()/2], entities = (double)n*k.weight;
+	printf("kernel %s entities %d per %s samples %d ns-min %.0f ns-median %.0f ns-mean %.0f ns-stddev %.0f ns-max %.0f ns-per-entity %.3f cycles-per-entity %.3f\n",
+		k.name, n, k.per, reps, ns[0], median, mean, stddev, ns.back(), median/entities, cycles[cycles.size()/2]/entities);
+	fflush(stdout);
+}
+
+int main (int argc, char** argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "--compare")) {
+		compareVariants(argc > 2 ? atoi(argv[2]) : 10000, argc > 3 ? atoi(argv[3]) : 10000);
+		return 0;
+	}
+	vector<int> counts;
+	const char* only = NULL;
+	int warmup = 3, reps = 21;
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "--kernel") && i+1 < argc)
+			only = argv[++i];
+		else if (!strcmp(argv[i], "--counts") && i+1 < argc) {
+			// comma separated, e.g. 10,1000,100000
+			for (char* c = strtok(argv[++i], ","); c; c = strtok(NULL, ","))
+				if (atoi(c) > 0)
+					counts.push_back(atoi(c));
+		}
+		else if (!strcmp(argv[i], "--reps") && i+1 < argc)
+			reps = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "--warmup") && i+1 < argc)
+			warmup = max(0, atoi(argv[++i]));
+		else {
+			fprintf(stderr, "usage: %s [--kernel NAME] [--counts N,N,...] [--reps N] [--warmup N]\n"
+				"       %s --compare [bullets] [blocks]\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+	if (counts.empty())
+		for (int n=10; n<=100000; n*=10)
+			counts.push_back(n);
+
+	bool any = !only;
+	for (int k=0; k<KERNELS && !any; k++)
+		any = !strcmp(only, kernels[k].name);
+	if (!any) {
+		fprintf(stderr, "No kernel %s (move, mirrors, buckets, collide, spawn)\n", only);
+		return 1;
+	}
+
+	double overheadNs, overheadCycles;
+	clockOverhead(overheadNs, overheadCycles);
+	printf("clock-overhead-ns %.0f clock-overhead-cycles %.0f warmup %d\n", overheadNs, overheadCycles, warmup);
+	for (int k=0; k<KERNELS; k++)
+		if (!only || !strcmp(only, kernels[k].name))
+			for (size_t c=0; c<counts.size(); c++)
+				runKernel(kernels[k], counts[c], warmup, reps, overheadNs, overheadCycles);
+	return 0;
+}
@@ -0,0 +1,118 @@
+#ifndef ENTITY_POOL_H
+#define ENTITY_POOL_H
+
+#include <cmath>
+#include <vector>
+
+/* Falling blocks and bullets are kept as structure-of-arrays pools.
+   Live entities always occupy indices [0, count) of every column: removal
+   moves the last entity into the freed slot (swap-and-pop), so loops only
+   ever visit live entities and no per-entity "dead" flag is needed.
+   Columns are std::vectors, so capacity grows on demand and slots freed by
+   a removal are reused by the next spawn without reallocating. */
+
+enum BlockColour { BLOCK_RED = 0, BLOCK_GREEN = 1, BLOCK_BLACK = 2 };
+
+/* Entities leaving this box are retired. It is wide enough to stay off
+   screen at the smallest zoom (0.2) with some panning */
+#define POOL_RETIRE_LIMIT 25.0f
+
+struct BlockPool {
+	std::vector<float> x;      // centre x, fixed at spawn
+	std::vector<float> y;      // centre y, decreases every tick
+	std::vector<float> py;     // y at the start of the current tick
+	std::vector<unsigned char> colour; // BlockColour
+	std::vector<int> handle;   // stable id while a catch is pending, or -1
+	int count;
+
+	BlockPool () : count(0) {}
+};
+
+struct BulletPool {
+	std::vector<float> x;        // distance travelled along x since firing
+	std::vector<float> y;        // distance travelled along y since firing
+	std::vector<float> px, py;   // x, y at the start of the current tick
+	std::vector<float> adjusty;  // gun height at the moment of firing
+	std::vector<float> rotation; // heading in degrees
+	std::vector<float> vx, vy;   // displacement per tick along the heading
+	int count;
+
+	BulletPool () : count(0) {}
+};
+
+/* Add a block and return its index */
+inline int spawnBlock (BlockPool& pool, float x, float y, int colour)
+{
+	pool.x.push_back(x);
+	pool.y.push_back(y);
+	pool.py.push_back(y);
+	pool.colour.push_back((unsigned char)colour);
+	pool.handle.push_back(-1);
+	return pool.count++;
+}
+
+/* Remove block i; the block previously at count-1 now lives at i */
+inline void killBlock (BlockPool& pool, int i)
+{
+	int last = --pool.count;
+	pool.x[i] = pool.x[last];
+	pool.y[i] = pool.y[last];
+	pool.py[i] = pool.py[last];
+	pool.colour[i] = pool.colour[last];
+	pool.handle[i] = pool.handle[last];
+	pool.x.pop_back();
+	pool.y.pop_back();
+	pool.py.pop_back();
+	pool.colour.pop_back();
+	pool.handle.pop_back();
+}
+
+/* Turn bullet i to 'rotation' degrees, moving 'step' units per tick. The
+   only place a heading goes through sin and cos : at firing, never while
+   the bullet flies */
+inline void headBullet (BulletPool& pool, int i, float rotation, float step)
+{
+	pool.rotation[i] = rotation;
+	pool.vx[i] = step*cos(rotation*M_PI/180.0);
+	pool.vy[i] = step*sin(rotation*M_PI/180.0);
+}
+
+/* Add a bullet leaving the gun at height 'adjusty', moving 'step' units
+   per tick, and return its index */
+inline int spawnBullet (BulletPool& pool, float adjusty, float rotation, float step)
+{
+	pool.x.push_back(0);
+	pool.y.push_back(0);
+	pool.px.push_back(0);
+	pool.py.push_back(0);
+	pool.adjusty.push_back(adjusty);
+	pool.rotation.push_back(0);
+	pool.vx.push_back(0);
+	pool.vy.push_back(0);
+	headBullet(pool, pool.count, rotation, step);
+	return pool.count++;
+}
+
+/* Remove bullet i; the bullet previously at count-1 now lives at i */
+inline void killBullet (BulletPool& pool, int i)
+{
+	int last = --pool.count;
+	pool.x[i] = pool.x[last];
+	pool.y[i] = pool.y[last];
+	pool.px[i] = pool.px[last];
+	pool.py[i] = pool.py[last];
+	pool.adjusty[i] = pool.adjusty[last];
+	pool.rotation[i] = pool.rotation[last];
+	pool.vx[i] = pool.vx[last];
+	pool.vy[i] = pool.vy[last];
+	pool.x.pop_back();
+	pool.y.pop_back();
+	pool.px.pop_back();
+	pool.py.pop_back();
+	pool.adjusty.pop_back();
+	pool.rotation.pop_back();
+	pool.vx.pop_back();
+	pool.vy.pop_back();
+}
+
+#endif
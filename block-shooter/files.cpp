@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <unistd.h>
+#include "files.h"
+
+using namespace std;
+
+unsigned long long fnv1a (const void* data, size_t size, unsigned long long hash)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i=0; i<size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool readText (const char* path, string& text)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return false;
+	char chunk[4096];
+	size_t n;
+	text.clear();
+	while ((n = fread(chunk, 1, sizeof chunk, f)) > 0)
+		text.append(chunk, n);
+	fclose(f);
+	return true;
+}
+
+bool atomicOpen (AtomicFile& file, const char* path)
+{
+	char pid[32];
+	snprintf(pid, sizeof pid, ".%d.tmp", (int)getpid());
+	file.path = path;
+	file.tmp = file.path + pid;
+	file.f = fopen(file.tmp.c_str(), "wb");
+	if (file.f == NULL) {
+		fprintf(stderr, "Cannot write %s\n", file.tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool atomicCommit (AtomicFile& file, bool ok)
+{
+	ok = !ferror(file.f) && ok;
+	ok = fclose(file.f) == 0 && ok;
+	file.f = NULL;
+	if (ok)
+		ok = rename(file.tmp.c_str(), file.path.c_str()) == 0;
+	if (!ok)
+		unlink(file.tmp.c_str());
+	return ok;
+}
@@ -0,0 +1,42 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+
+/* File helpers shared by the level compiler and the asset caches, and the
+   one hash the game uses everywhere.
+
+   Files the game writes for itself (compiled levels, shader binaries,
+   decoded sounds) hold raw structs in host byte order : they are machine
+   local and rebuilt from their source whenever missing or stale, never
+   shipped. Each is written through an AtomicFile : the data goes to a
+   temporary file beside the target ("<path>.<pid>.tmp", which the asset
+   watcher ignores) and is renamed over it only once complete, so a crash
+   mid-write never leaves a truncated file and a running game never maps
+   a half written one. */
+
+#define FNV_OFFSET 14695981039346656037ULL
+
+/* FNV-1a 64 of 'size' bytes, continuing from 'hash' */
+unsigned long long fnv1a (const void* data, size_t size, unsigned long long hash = FNV_OFFSET);
+
+/* Whole contents of 'path'; false if it cannot be read */
+bool readText (const char* path, std::string& text);
+
+struct AtomicFile {
+	FILE* f;             // the temporary file, written by the caller
+	std::string path, tmp;
+};
+
+/* Open a temporary file to become 'path'. False (with a message) if it
+   cannot be created */
+bool atomicOpen (AtomicFile& file, const char* path);
+
+/* Close the temporary file and, if it was written without error and the
+   caller says 'ok', rename it to its path; otherwise remove it. False if
+   the file did not replace its path */
+bool atomicCommit (AtomicFile& file, bool ok=true);
+
+#endif
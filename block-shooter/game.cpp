@@ -0,0 +1,556 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "game.h"
+#include "profiler.h"
+#include "integrate.h"
+#include "level.h"
+#include "files.h"
+
+using namespace std;
+
+BlockPool blockPool;
+BulletPool bulletPool;
+SpatialGrid blockGrid;
+vector<char> blockHit;
+float score=0,change=0,speed=1.8,rotation_angle=0;
+int t=0;
+bool game_over=false;
+vector<GameEvent> gameEvents;
+vector<Mirror> mirrors;
+vector<Bucket> buckets;
+
+// the level's settings, see level.h
+float gunX=-3.75;
+unsigned long long levelHash=0;
+static float startSpeed=1.8, spawnY=4.5;
+static int spawnPeriod=SIM_HZ*5/6, spawnXMin=-280, spawnXSteps=680;
+static vector<LevelSpawn> spawnTable;
+static int spawnWeights=0;
+
+/* Bucket catches. Every block falls at the same speed, so the order in
+   which blocks reach any height is known as they spawn. Each block waits
+   in a heap keyed by how far the blocks will have fallen when its bottom
+   reaches the next bucket top below it (a catch line). A step pops only
+   the blocks crossing a line and resolves them against that line's
+   buckets; a miss waits for the next line down, or leaves the queue and
+   falls out of sight. Removals move blocks around the pool, so queued
+   blocks are known by a handle that catchSlot maps to their index */
+struct Crossing {
+	double at;     // 'fallen' when the block's bottom reaches the line
+	int handle;
+	int line;      // index in catchLines
+};
+static vector<Crossing> crossings;  // heap, earliest on top
+static vector<int> catchSlot;       // handle -> pool index, -1 once removed
+static vector<int> freeHandles;
+static vector<double> catchLines;   // distinct bucket tops, highest first
+static double fallen=0;             // how far every block fell since resetGame()
+
+/* Own generator rather than rand() : the sequence depends only on the seed,
+   never on the C library or on who else calls rand(), which replays need */
+static unsigned long long rng_state;
+
+unsigned int simRand ()
+{
+	// xorshift64*
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (unsigned int)((rng_state * 2685821657736338717ULL) >> 33);
+}
+
+static void emitEvent (int type, float x, float y, int colour=-1)
+{
+	GameEvent e = { type, x, y, colour };
+	gameEvents.push_back(e);
+}
+
+void addMirror (float cx, float cy, float angle, float half)
+{
+	Mirror m;
+	float a=angle*M_PI/180.0f;
+	m.cx=cx;
+	m.cy=cy;
+	m.angle=angle;
+	m.half=half;
+	m.ax=cx-half*cos(a);
+	m.ay=cy-half*sin(a);
+	m.bx=cx+half*cos(a);
+	m.by=cy+half*sin(a);
+	m.nx=-sin(a);
+	m.ny=cos(a);
+	m.minx=min(m.ax,m.bx);
+	m.maxx=max(m.ax,m.bx);
+	m.miny=min(m.ay,m.by);
+	m.maxy=max(m.ay,m.by);
+	mirrors.push_back(m);
+}
+
+static void addBucket (float x, float y, int colour)
+{
+	Bucket b = { x, y, colour, 0 };
+	buckets.push_back(b);
+}
+
+static double bucketTop (const Bucket& b)
+{
+	return b.y+0.4;
+}
+
+static bool laterCrossing (const Crossing& a, const Crossing& b)
+{
+	return a.at>b.at;
+}
+
+/* Queue block i for crossing catch line 'line' */
+static void queueCatch (int i, int line)
+{
+	int h=blockPool.handle[i];
+	if(h<0)
+	{
+		if(freeHandles.empty())
+		{
+			h=catchSlot.size();
+			catchSlot.push_back(i);
+		}
+		else
+		{
+			h=freeHandles.back();
+			freeHandles.pop_back();
+			catchSlot[h]=i;
+		}
+		blockPool.handle[i]=h;
+	}
+	Crossing c = { fallen+(-0.1+blockPool.y[i]-catchLines[line]), h, line };
+	crossings.push_back(c);
+	push_heap(crossings.begin(),crossings.end(),laterCrossing);
+}
+
+/* Queue block i for the first catch line it is still above, if any. A
+   block already at or under a line (spawned there, or put there by a
+   level) never crosses it, so must not be caught by it */
+static void queueFirstCatch (int i)
+{
+	size_t j;
+	for(j=0;j<catchLines.size() && -0.1+blockPool.y[i]<=catchLines[j];j++)
+		;
+	if(j<catchLines.size())
+		queueCatch(i,j);
+}
+
+/* Remove block i. A queued crossing of it stays in the heap and is
+   dropped when it comes up, which is when its handle is reused */
+static void removeBlock (int i)
+{
+	int last=blockPool.count-1;
+	if(blockPool.handle[last]>=0)
+		catchSlot[blockPool.handle[last]]=i;
+	if(blockPool.handle[i]>=0)
+		catchSlot[blockPool.handle[i]]=-1;
+	killBlock(blockPool,i);
+}
+
+/* Take the catch lines from the buckets, and queue every block for the
+   first line it is still above */
+void resetCatches ()
+{
+	size_t j;
+	catchLines.clear();
+	for(j=0;j<buckets.size();j++)
+		catchLines.push_back(bucketTop(buckets[j]));
+	sort(catchLines.begin(),catchLines.end(),greater<double>());
+	catchLines.erase(unique(catchLines.begin(),catchLines.end()),catchLines.end());
+	crossings.clear();
+	catchSlot.clear();
+	freeHandles.clear();
+	for(int i=0;i<blockPool.count;i++)
+	{
+		blockPool.handle[i]=-1;
+		queueFirstCatch(i);
+	}
+}
+
+static void addSpawn (int colour, int weight)
+{
+	LevelSpawn s = { colour, weight };
+	spawnTable.push_back(s);
+	spawnWeights+=weight;
+}
+
+/* The layout the game had before levels, for running without level files */
+static void builtinLevel ()
+{
+	mirrors.clear();
+	addMirror(3,0,90,0.4);
+	addMirror(2,3,120,0.4);
+	addMirror(1,-2,60,0.4);
+	addMirror(-2.5,2.5,15,0.4);
+	buckets.clear();
+	addBucket(-2,-3.6,BLOCK_RED);
+	addBucket(2,-3.6,BLOCK_GREEN);
+	spawnTable.clear();
+	spawnWeights=0;
+	addSpawn(BLOCK_RED,1);
+	addSpawn(BLOCK_GREEN,1);
+	addSpawn(BLOCK_BLACK,1);
+}
+
+void applyLevel (const Level& level)
+{
+	const LevelHeader& h=*level.header;
+	unsigned int i;
+	mirrors.clear();
+	for(i=0;i<h.mirrors;i++)
+		addMirror(level.mirrors[i].cx,level.mirrors[i].cy,level.mirrors[i].angle,level.mirrors[i].half);
+	// buckets keep where the player moved them
+	vector<Bucket> old;
+	old.swap(buckets);
+	for(i=0;i<h.buckets;i++)
+	{
+		addBucket(level.buckets[i].x,level.buckets[i].y,level.buckets[i].colour);
+		if(i<old.size())
+			buckets[i].offset=old[i].offset;
+	}
+	spawnTable.clear();
+	spawnWeights=0;
+	for(i=0;i<h.spawns;i++)
+		addSpawn(level.spawns[i].colour,level.spawns[i].weight);
+	gunX=h.gun_x;
+	startSpeed=h.speed;
+	spawnY=h.spawn_y;
+	spawnPeriod=h.spawn_period;
+	spawnXMin=h.spawn_x_min;
+	spawnXSteps=h.spawn_x_steps;
+	levelHash=h.source_hash;
+	resetCatches();
+}
+
+void resetGame (unsigned int seed)
+{
+	// splitmix the seed so that 0 and neighbouring seeds give unrelated streams
+	unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	rng_state = (z ^ (z >> 31)) | 1;
+	blockPool = BlockPool();
+	bulletPool = BulletPool();
+	score=0;
+	change=0;
+	speed=startSpeed;
+	rotation_angle=0;
+	t=0;
+	game_over=false;
+	gameEvents.clear();
+	if(spawnTable.empty())
+		builtinLevel();
+	for(size_t i=0;i<buckets.size();i++)
+		buckets[i].offset=0;
+	fallen=0;
+	resetCatches();
+}
+
+void fireBullet ()
+{
+	spawnBullet(bulletPool, change, rotation_angle, BULLET_SPEED*SIM_DT);
+	emitEvent(EV_SHOT, gunX+GUN_MUZZLE, change);
+}
+
+void aimGun (float degrees)
+{
+	rotation_angle+=degrees;
+}
+
+void moveGun (float dy)
+{
+	change+=dy;
+}
+
+void moveBucket (int bucket, float dx)
+{
+	if(bucket>=1 && bucket<=(int)buckets.size())
+		buckets[bucket-1].offset+=dx;
+}
+
+void scaleSpeed (float factor)
+{
+	speed*=factor;
+}
+
+void applyAction (int action, float value)
+{
+	switch(action)
+	{
+		case ACT_FIRE: fireBullet(); break;
+		case ACT_AIM: aimGun(value); break;
+		case ACT_GUN: moveGun(value); break;
+		case ACT_BUCKET1: moveBucket(1,value); break;
+		case ACT_BUCKET2: moveBucket(2,value); break;
+		case ACT_SPEED: scaleSpeed(value); break;
+	}
+}
+
+void captureSnapshot (GameSnapshot& snapshot)
+{
+	snapshot.t=t;
+	snapshot.score=score;
+	snapshot.change=change;
+	snapshot.speed=speed;
+	snapshot.rotation_angle=rotation_angle;
+	snapshot.gunX=gunX;
+	snapshot.game_over=game_over;
+	snapshot.blocks=blockPool;
+	snapshot.bullets=bulletPool;
+	snapshot.mirrors=mirrors;
+	snapshot.buckets=buckets;
+}
+
+/* Everything a step or an input can change, so that a replay applying
+   any action differently shows up even when the score agrees */
+unsigned long long stateHash ()
+{
+	unsigned long long h = FNV_OFFSET;
+	h = fnv1a(&t, sizeof t, h);
+	h = fnv1a(&score, sizeof score, h);
+	h = fnv1a(&rng_state, sizeof rng_state, h);
+	h = fnv1a(&game_over, sizeof game_over, h);
+	// the player's gun, aim and speed
+	h = fnv1a(&change, sizeof change, h);
+	h = fnv1a(&rotation_angle, sizeof rotation_angle, h);
+	h = fnv1a(&speed, sizeof speed, h);
+	for(size_t i=0;i<buckets.size();i++)
+		h = fnv1a(&buckets[i].offset, sizeof buckets[i].offset, h);
+	h = fnv1a(&blockPool.count, sizeof blockPool.count, h);
+	h = fnv1a(blockPool.x.data(), blockPool.count*sizeof(float), h);
+	h = fnv1a(blockPool.y.data(), blockPool.count*sizeof(float), h);
+	h = fnv1a(blockPool.colour.data(), blockPool.count, h);
+	h = fnv1a(&bulletPool.count, sizeof bulletPool.count, h);
+	h = fnv1a(bulletPool.x.data(), bulletPool.count*sizeof(float), h);
+	h = fnv1a(bulletPool.y.data(), bulletPool.count*sizeof(float), h);
+	h = fnv1a(bulletPool.adjusty.data(), bulletPool.count*sizeof(float), h);
+	h = fnv1a(bulletPool.rotation.data(), bulletPool.count*sizeof(float), h);
+	h = fnv1a(bulletPool.vx.data(), bulletPool.count*sizeof(float), h);
+	h = fnv1a(bulletPool.vy.data(), bulletPool.count*sizeof(float), h);
+	return h;
+}
+
+/* Replay bullet i's last step, from (px, py) along (vx, vy), against the
+   mirrors : wherever the path crosses a mirror the bullet continues from
+   the crossing point with its velocity reflected about the mirror, for
+   the rest of the step. Mirrors are tested in the order the path meets
+   them, so a step can bounce several times and nothing tunnels through a
+   mirror however fast it moves. A bounding box test rejects most mirrors
+   before the exact test */
+static void sweepMirrors (int i)
+{
+	// centre of the bullet on the playfield, as the collision tests use
+	float ox=gunX+GUN_MUZZLE+bulletPool.px[i], oy=bulletPool.adjusty[i]+bulletPool.py[i];
+	float dx=bulletPool.vx[i], dy=bulletPool.vy[i];
+	float left=1;   // fraction of the step still to travel
+	int last=-1;    // mirror just bounced off, which the path is leaving
+	int bounces;
+	for(bounces=0;bounces<MIRROR_MAX_BOUNCES;bounces++)
+	{
+		float ex=ox+dx*left, ey=oy+dy*left;
+		float lox=min(ox,ex), hix=max(ox,ex), loy=min(oy,ey), hiy=max(oy,ey);
+		float first=left;
+		int hit=-1;
+		for(int m=0;m<(int)mirrors.size();m++)
+		{
+			const Mirror& mr=mirrors[m];
+			if(m==last || mr.maxx<lox || mr.minx>hix || mr.maxy<loy || mr.miny>hiy)
+				continue;
+			// origin + s*(dx,dy) == a + u*(b-a), solved for s and u
+			float sx=mr.bx-mr.ax, sy=mr.by-mr.ay;
+			float denom=dx*sy-dy*sx;
+			if(denom==0)
+				continue; // moving along the mirror
+			float qx=mr.ax-ox, qy=mr.ay-oy;
+			float along=(qx*sy-qy*sx)/denom;
+			float u=(qx*dy-qy*dx)/denom;
+			if(along>=0 && along<first && u>=0 && u<=1)
+			{
+				first=along;
+				hit=m;
+			}
+		}
+		if(hit<0)
+			break;
+		ox+=dx*first;
+		oy+=dy*first;
+		left-=first;
+		float dot=dx*mirrors[hit].nx+dy*mirrors[hit].ny;
+		dx-=2*dot*mirrors[hit].nx;
+		dy-=2*dot*mirrors[hit].ny;
+		last=hit;
+		emitEvent(EV_BOUNCE, ox, oy);
+	}
+	if(bounces==0)
+		return;
+	bulletPool.x[i]=ox+dx*left-(gunX+GUN_MUZZLE);
+	bulletPool.y[i]=oy+dy*left-bulletPool.adjusty[i];
+	bulletPool.vx[i]=dx;
+	bulletPool.vy[i]=dy;
+	bulletPool.rotation[i]=atan2(dy,dx)*180.0/M_PI;
+}
+
+/* True if a block centred at x overlaps the bucket centred at 'centre' */
+static bool inBucket (float x, float centre)
+{
+	return ((centre-0.6f<=-0.1+x) and (-0.1+x<=centre+0.6f)) or ((centre-0.6f<=0.1+x) and (0.1+x<=centre+0.6f));
+}
+
+void moveEntities ()
+{
+	int i;
+	// remember where everything was so draw() can interpolate
+	blockPool.py=blockPool.y;
+	bulletPool.px=bulletPool.x;
+	bulletPool.py=bulletPool.y;
+	integrateFall(blockPool.y.data(), blockPool.count, speed*SIM_DT);
+	fallen+=speed*SIM_DT;
+	integrateBullets(bulletPool.x.data(), bulletPool.y.data(), bulletPool.vx.data(), bulletPool.vy.data(), bulletPool.count);
+	for(i=0;i<blockPool.count;i++)
+	{
+		// fell out of sight without being caught
+		if(blockPool.y[i]<-POOL_RETIRE_LIMIT)
+		{
+			removeBlock(i);
+			i--;
+		}
+	}
+}
+
+void reflectBullets ()
+{
+	int i;
+	///Reflection from mirrors
+	for(i=0;i<bulletPool.count;i++)
+		sweepMirrors(i);
+	for(i=0;i<bulletPool.count;i++)
+	{
+		// a straight line leaving the playfield never comes back to a mirror
+		if(abs(bulletPool.x[i])>POOL_RETIRE_LIMIT || abs(bulletPool.y[i])>POOL_RETIRE_LIMIT)
+		{
+			killBullet(bulletPool,i);
+			i--;
+		}
+	}
+}
+
+bool scoreBuckets ()
+{
+	int i,j;
+	/*colision with the buckets : only the blocks crossing a catch line*/
+	while(!crossings.empty())
+	{
+		Crossing c=crossings.front();
+		i=catchSlot[c.handle];
+		// the earliest crossing is still ahead, and so are all the others
+		if(i>=0 && -0.1+blockPool.y[i]>catchLines[c.line])
+			break;
+		pop_heap(crossings.begin(),crossings.end(),laterCrossing);
+		crossings.pop_back();
+		if(i<0)
+		{
+			freeHandles.push_back(c.handle); // shot on the way down
+			continue;
+		}
+		// the first bucket on this line under the block
+		int bucket=-1;
+		for(j=0;j<(int)buckets.size() && bucket<0;j++)
+			if(bucketTop(buckets[j])==catchLines[c.line] && inBucket(blockPool.x[i],bucketX(buckets[j])))
+				bucket=j;
+		if(bucket<0 && c.line+1<(int)catchLines.size())
+		{
+			queueCatch(i,c.line+1);
+			continue;
+		}
+		blockPool.handle[i]=-1;
+		freeHandles.push_back(c.handle);
+		if(bucket<0)
+			continue;
+		if(blockPool.colour[i]==BLOCK_BLACK)
+		{
+			game_over=true;
+			emitEvent(EV_GAME_OVER, blockPool.x[i], blockPool.y[i], blockPool.colour[i]);
+			return false;
+		}
+		// same colour bucket gains, any other loses
+		if(blockPool.colour[i]==buckets[bucket].colour)
+		{
+			score+=4;
+			emitEvent(EV_CATCH, blockPool.x[i], blockPool.y[i], blockPool.colour[i]);
+		}
+		else
+		{
+			score-=1;
+			emitEvent(EV_WRONG_BUCKET, blockPool.x[i], blockPool.y[i], blockPool.colour[i]);
+		}
+		removeBlock(i);
+	}
+	return true;
+}
+
+void collideBullets ()
+{
+	int i,j;
+	float cx,cy;
+	///check colision btw bullet and block
+	// broad phase : a bullet only tests blocks in the cells around it
+	buildGrid(blockGrid, blockPool.x.data(), blockPool.y.data(), blockPool.count);
+	blockHit.assign(blockPool.count, 0);
+	for(i=0;i<bulletPool.count;i++)
+	{
+		cx=gunX+GUN_MUZZLE+bulletPool.x[i];
+		cy=bulletPool.adjusty[i]+bulletPool.y[i];
+		j=queryGrid(blockGrid, blockPool.x.data(), blockPool.y.data(), blockHit, cx, cy, 0.2);
+		if(j<0)
+			continue;
+		//perfect shoot on black, penalty otherwise
+		if(blockPool.colour[j]==BLOCK_BLACK)
+			score+=2;
+		else
+			score-=1;
+		blockHit[j]=1;
+		emitEvent(EV_HIT, cx, cy, blockPool.colour[j]);
+		killBullet(bulletPool,i);
+		i--;
+	}
+	// blocks are removed only now so grid indices stay valid above;
+	// going downwards, swap-and-pop never moves a block still to be removed
+	for(j=blockPool.count-1;j>=0;j--)
+		if(blockHit[j])
+			removeBlock(j);
+}
+
+void spawnNext ()
+{
+	int i,j;
+	// a colour by the spawn table's weights, then an x in hundredths
+	int pick=simRand()%spawnWeights;
+	for(i=0;pick>=spawnTable[i].weight;i++)
+		pick-=spawnTable[i].weight;
+	j=spawnBlock(blockPool,(float)((spawnXMin+(int)(simRand()%spawnXSteps))/100.0),spawnY,spawnTable[i].colour);
+	queueFirstCatch(j);
+}
+
+void simulate ()
+{
+	ProfileTimer step(PROF_SIM_STEP);
+	ProfileTimer timer(PROF_MOVE);
+	t++;
+	moveEntities();
+	timer.lap(PROF_MIRRORS);
+	reflectBullets();
+	timer.lap(PROF_BUCKETS);
+	if(!scoreBuckets())
+		return;
+	timer.lap(PROF_COLLIDE);
+	collideBullets();
+	timer.lap(PROF_SPAWN);
+	if(t%spawnPeriod==0)
+		spawnNext();
+}
@@ -0,0 +1,126 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <vector>
+#include "entity_pool.h"
+#include "spatial_grid.h"
+
+/* Simulation core : spawning, movement, mirrors, bucket scoring and
+   bullet collision. Nothing here touches GL or GLUT, so the same code
+   drives the windowed game and the headless runner. */
+
+/* The game advances in fixed steps independent of the frame rate.
+   Speeds are in playfield units per second */
+#define SIM_HZ 120
+#define SIM_DT (1.0f/SIM_HZ)
+#define BULLET_SPEED 6.0f
+#define GUN_MUZZLE 0.3f          // bullets start this far right of the gun's pivot
+#define MIRROR_MAX_BOUNCES 8      // per bullet and step, against corner traps
+
+/* A mirror is a segment reflecting bullets off either side */
+struct Mirror {
+	float cx, cy, angle, half;  // centre, angle in degrees and half length
+	float ax, ay, bx, by;       // end points
+	float nx, ny;               // unit normal
+	float minx, miny, maxx, maxy; // bounding box
+};
+
+extern std::vector<Mirror> mirrors;
+
+/* Add a mirror of length 2*half centred at (cx, cy), turned by 'angle' */
+void addMirror (float cx, float cy, float angle, float half);
+
+/* A bucket catches blocks of its colour. The player moves the first two
+   (ACT_BUCKET1 and ACT_BUCKET2) */
+struct Bucket {
+	float x, y;       // centre as the level places it
+	int colour;       // BlockColour
+	float offset;     // player's move, positive is to the left
+};
+
+extern std::vector<Bucket> buckets;
+
+inline float bucketX (const Bucket& b)
+{
+	return b.x-b.offset;
+}
+
+/* Replace the gun, mirrors, buckets and spawn table with a loaded level's.
+   Until one is applied the game uses the built-in layout, the same as
+   levels/default.txt. Takes effect at once, for hot reloading; the start
+   speed applies from the next resetGame() */
+struct Level;
+void applyLevel (const Level& level);
+
+extern float gunX;                   // x of the gun's pivot
+extern unsigned long long levelHash; // source hash of the applied level, 0 if built in
+
+extern BlockPool blockPool;
+extern BulletPool bulletPool;
+extern float score, change, speed, rotation_angle;
+extern int t;              // steps simulated since resetGame()
+extern bool game_over;     // a black block landed in a bucket
+
+/* What happened during the steps simulated so far, for sounds and
+   effects. The simulation only appends; the consumer clears the list
+   after handling it */
+enum GameEventType { EV_SHOT, EV_BOUNCE, EV_HIT, EV_CATCH, EV_WRONG_BUCKET, EV_GAME_OVER };
+struct GameEvent {
+	int type;
+	float x, y;   // where, in playfield units
+	int colour;   // BlockColour of the block involved, -1 for none
+};
+extern std::vector<GameEvent> gameEvents;
+
+/* A copy of everything that is drawn, taken between two steps, so that
+   another thread can draw it while the simulation moves on */
+struct GameSnapshot {
+	int t;
+	float score, change, speed, rotation_angle, gunX;
+	bool game_over;
+	BlockPool blocks;
+	BulletPool bullets;
+	std::vector<Mirror> mirrors;
+	std::vector<Bucket> buckets;
+};
+
+/* Copy the current state into 'snapshot', reusing its storage */
+void captureSnapshot (GameSnapshot& snapshot);
+
+/* Start a new game, seeding the block spawner */
+void resetGame (unsigned int seed);
+
+/* Next value of the game's random stream, seeded by resetGame() */
+unsigned int simRand ();
+
+/* Advance the game by one fixed step of SIM_DT seconds */
+void simulate ();
+
+/* The phases of simulate(), in its order, for timing them one at a time
+   (bench). scoreBuckets() is false once a black block is caught, which
+   ends the step; spawnNext() spawns whether or not a block is due */
+void moveEntities ();
+void reflectBullets ();
+bool scoreBuckets ();
+void collideBullets ();
+void spawnNext ();
+
+/* Forget the pending catches and queue every block in blockPool again,
+   after the pool was filled some other way than by spawning */
+void resetCatches ();
+
+/* Player actions, shared by the GLUT callbacks and scripted input */
+void fireBullet ();
+void aimGun (float degrees);
+void moveGun (float dy);
+void moveBucket (int bucket, float dx);
+void scaleSpeed (float factor);
+
+/* The same actions as data, for scripts and recorded sessions */
+enum GameAction { ACT_FIRE, ACT_AIM, ACT_GUN, ACT_BUCKET1, ACT_BUCKET2, ACT_SPEED, ACT_COUNT };
+void applyAction (int action, float value);
+
+/* Fingerprint of the simulation state, equal across bit-exact runs */
+unsigned long long stateHash ();
+
+#endif
@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include "game.h"
+#include "replay.h"
+#include "profiler.h"
+#include "level.h"
+
+using namespace std;
+
+/* Headless runner : plays many games back to back with no window or GL
+   context, feeding player actions from a script, and reports simulation
+   throughput. Used for balancing runs on machines without a display.
+
+   Script lines are "<tick> <action> [value]", '#' starts a comment:
+     120 fire
+     130 aim 5          rotate the gun by 5 degrees
+     140 gun 0.2        move the gun up by 0.2
+     150 bucket1 -0.3   move a bucket (positive is to the left)
+     160 speed 2        scale the falling speed
+   Every game replays the same script from tick 0.
+
+   --replay plays back a session recorded with --record (here or in the
+   windowed game) as fast as possible and checks that it ends in the same
+   state it was recorded with.
+
+   --level plays a level other than levels/default.txt; without a
+   readable level file the built-in layout is used. */
+
+bool earlierEvent (const ReplayEvent& a, const ReplayEvent& b)
+{
+	return a.tick < b.tick;
+}
+
+/* Parse a script file into events ordered by tick */
+bool loadScript (const char* path, vector<ReplayEvent>& events)
+{
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open script %s\n", path);
+		return false;
+	}
+	char line[256], name[32];
+	int lineno = 0;
+	while (fgets(line, sizeof line, f)) {
+		lineno++;
+		char* hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		ReplayEvent e;
+		e.value = 0;
+		int n = sscanf(line, "%d %31s %f", &e.tick, name, &e.value);
+		if (n <= 0)
+			continue;
+		if (n == 1) {
+			fprintf(stderr, "%s:%d: missing action\n", path, lineno);
+			fclose(f);
+			return false;
+		}
+		if (!strcmp(name, "fire")) e.action = ACT_FIRE;
+		else if (!strcmp(name, "aim")) e.action = ACT_AIM;
+		else if (!strcmp(name, "gun")) e.action = ACT_GUN;
+		else if (!strcmp(name, "bucket1")) e.action = ACT_BUCKET1;
+		else if (!strcmp(name, "bucket2")) e.action = ACT_BUCKET2;
+		else if (!strcmp(name, "speed")) e.action = ACT_SPEED;
+		else {
+			fprintf(stderr, "%s:%d: unknown action '%s'\n", path, lineno, name);
+			fclose(f);
+			return false;
+		}
+		events.push_back(e);
+	}
+	fclose(f);
+	stable_sort(events.begin(), events.end(), earlierEvent);
+	return true;
+}
+
+void usage (const char* argv0)
+{
+	fprintf(stderr, "usage: %s [--games N] [--ticks N] [--seed S] [--script FILE] [--record FILE] [--replay FILE] [--profile FILE] [--level FILE] [--verbose]\n", argv0);
+	exit(1);
+}
+
+int main (int argc, char** argv)
+{
+	int games = 1, maxTicks = SIM_HZ*60*5; // five minutes of play
+	unsigned int seed = 1;
+	bool verbose = false;
+	vector<ReplayEvent> script;
+	const char* recordPath = NULL;
+	const char* levelPath = LEVEL_DEFAULT;
+	Replay replay;
+	bool replaying = false;
+
+	for (int i=1; i<argc; i++) {
+		if (!strcmp(argv[i], "--games") && i+1 < argc)
+			games = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--ticks") && i+1 < argc)
+			maxTicks = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i+1 < argc)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--script") && i+1 < argc) {
+			if (!loadScript(argv[++i], script))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "--record") && i+1 < argc)
+			recordPath = argv[++i];
+		else if (!strcmp(argv[i], "--replay") && i+1 < argc) {
+			if (!loadReplay(argv[++i], replay))
+				return 1;
+			replaying = true;
+		}
+		else if (!strcmp(argv[i], "--profile") && i+1 < argc) {
+			if (!profileOpenCSV(argv[++i]))
+				return 1;
+			profile_enabled = true;
+		}
+		else if (!strcmp(argv[i], "--level") && i+1 < argc)
+			levelPath = argv[++i];
+		else if (!strcmp(argv[i], "--verbose"))
+			verbose = true;
+		else
+			usage(argv[0]);
+	}
+
+	Level level;
+	if (levelLoad(levelPath, level))
+		applyLevel(level);
+	else
+		fprintf(stderr, "Playing the built-in level\n");
+
+	if (replaying) {
+		if (replay.levelHash != levelHash) {
+			fprintf(stderr, "The replay was recorded on another level (%016llx)\n", replay.levelHash);
+			return 1;
+		}
+		// one game with the recorded seed, ending where the recording ended
+		script = replay.events;
+		seed = replay.seed;
+		games = 1;
+		if (replay.endTick >= 0)
+			maxTicks = replay.endTick;
+	}
+
+	long long totalTicks = 0;
+	int gameOvers = 0;
+	double totalScore = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for (int g=0; g<games; g++) {
+		resetGame(seed+g);
+		if (g == 0 && recordPath && !startRecording(recordPath, seed))
+			return 1;
+		size_t next = 0;
+		while (!game_over) {
+			// actions scheduled for this tick land before it is simulated,
+			// as input received between two idle() steps does in the game
+			while (next < script.size() && script[next].tick <= t) {
+				if (g == 0)
+					recordAction(t, script[next].action, script[next].value);
+				applyAction(script[next].action, script[next].value);
+				next++;
+			}
+			if (t >= maxTicks)
+				break;
+			simulate();
+			gameEvents.clear(); // nobody to play them to
+			profileTick();
+		}
+		if (g == 0)
+			stopRecording(t, stateHash());
+		totalTicks += t;
+		totalScore += score;
+		gameOvers += game_over;
+		if (verbose)
+			printf("game %d seed %u: %d ticks score %g%s\n", g, seed+g, t, score, game_over ? " (game over)" : "");
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("games %d ticks %lld game-overs %d mean-score %.3f\n", games, totalTicks, gameOvers, totalScore/games);
+	if (replaying && replay.endTick >= 0) {
+		bool match = stateHash() == replay.endHash;
+		printf("replay %s at tick %d (state %016llx)\n", match ? "matches" : "DIVERGED", t, stateHash());
+		if (!match)
+			return 2;
+	}
+	printf("elapsed %.3f s, %.0f ticks/s (%.1fx real time)\n", seconds, totalTicks/seconds, totalTicks/seconds/SIM_HZ);
+	return 0;
+}
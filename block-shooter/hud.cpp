@@ -0,0 +1,166 @@
+#include <cstring>
+#include <string>
+#include "hud.h"
+
+using namespace std;
+
+/* Rows of every glyph from ASCII 32 to 95, top first, bit 4 leftmost */
+static const unsigned char font[64][HUD_GLYPH_H] = {
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x00}, // space
+	{0x04,0x04,0x04,0x04,0x04,0x00,0x04}, // !
+	{0x0A,0x0A,0x0A,0x00,0x00,0x00,0x00}, // "
+	{0x0A,0x0A,0x1F,0x0A,0x1F,0x0A,0x0A}, // #
+	{0x04,0x0F,0x14,0x0E,0x05,0x1E,0x04}, // $
+	{0x18,0x19,0x02,0x04,0x08,0x13,0x03}, // %
+	{0x0C,0x12,0x14,0x08,0x15,0x12,0x0D}, // &
+	{0x0C,0x04,0x08,0x00,0x00,0x00,0x00}, // '
+	{0x02,0x04,0x08,0x08,0x08,0x04,0x02}, // (
+	{0x08,0x04,0x02,0x02,0x02,0x04,0x08}, // )
+	{0x00,0x04,0x15,0x0E,0x15,0x04,0x00}, // *
+	{0x00,0x04,0x04,0x1F,0x04,0x04,0x00}, // +
+	{0x00,0x00,0x00,0x00,0x0C,0x04,0x08}, // ,
+	{0x00,0x00,0x00,0x1F,0x00,0x00,0x00}, // -
+	{0x00,0x00,0x00,0x00,0x00,0x0C,0x0C}, // .
+	{0x00,0x01,0x02,0x04,0x08,0x10,0x00}, // /
+	{0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, // 0
+	{0x04,0x0C,0x04,0x04,0x04,0x04,0x0E}, // 1
+	{0x0E,0x11,0x01,0x02,0x04,0x08,0x1F}, // 2
+	{0x1F,0x02,0x04,0x02,0x01,0x11,0x0E}, // 3
+	{0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, // 4
+	{0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E}, // 5
+	{0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, // 6
+	{0x1F,0x01,0x02,0x04,0x08,0x08,0x08}, // 7
+	{0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E}, // 8
+	{0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C}, // 9
+	{0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00}, // :
+	{0x00,0x0C,0x0C,0x00,0x0C,0x04,0x08}, // ;
+	{0x02,0x04,0x08,0x10,0x08,0x04,0x02}, // <
+	{0x00,0x00,0x1F,0x00,0x1F,0x00,0x00}, // =
+	{0x08,0x04,0x02,0x01,0x02,0x04,0x08}, // >
+	{0x0E,0x11,0x01,0x02,0x04,0x00,0x04}, // ?
+	{0x0E,0x11,0x01,0x0D,0x15,0x15,0x0E}, // @
+	{0x0E,0x11,0x11,0x11,0x1F,0x11,0x11}, // A
+	{0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}, // B
+	{0x0E,0x11,0x10,0x10,0x10,0x11,0x0E}, // C
+	{0x1C,0x12,0x11,0x11,0x11,0x12,0x1C}, // D
+	{0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F}, // E
+	{0x1F,0x10,0x10,0x1E,0x10,0x10,0x10}, // F
+	{0x0E,0x11,0x10,0x17,0x11,0x11,0x0F}, // G
+	{0x11,0x11,0x11,0x1F,0x11,0x11,0x11}, // H
+	{0x0E,0x04,0x04,0x04,0x04,0x04,0x0E}, // I
+	{0x07,0x02,0x02,0x02,0x02,0x12,0x0C}, // J
+	{0x11,0x12,0x14,0x18,0x14,0x12,0x11}, // K
+	{0x10,0x10,0x10,0x10,0x10,0x10,0x1F}, // L
+	{0x11,0x1B,0x15,0x15,0x11,0x11,0x11}, // M
+	{0x11,0x11,0x19,0x15,0x13,0x11,0x11}, // N
+	{0x0E,0x11,0x11,0x11,0x11,0x11,0x0E}, // O
+	{0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}, // P
+	{0x0E,0x11,0x11,0x11,0x15,0x12,0x0D}, // Q
+	{0x1E,0x11,0x11,0x1E,0x14,0x12,0x11}, // R
+	{0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E}, // S
+	{0x1F,0x04,0x04,0x04,0x04,0x04,0x04}, // T
+	{0x11,0x11,0x11,0x11,0x11,0x11,0x0E}, // U
+	{0x11,0x11,0x11,0x11,0x11,0x0A,0x04}, // V
+	{0x11,0x11,0x11,0x15,0x15,0x15,0x0A}, // W
+	{0x11,0x11,0x0A,0x04,0x0A,0x11,0x11}, // X
+	{0x11,0x11,0x11,0x0A,0x04,0x04,0x04}, // Y
+	{0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}, // Z
+	{0x0E,0x08,0x08,0x08,0x08,0x08,0x0E}, // [
+	{0x00,0x10,0x08,0x04,0x02,0x01,0x00}, // backslash
+	{0x0E,0x02,0x02,0x02,0x02,0x02,0x0E}, // ]
+	{0x04,0x0A,0x11,0x00,0x00,0x00,0x00}, // ^
+	{0x00,0x00,0x00,0x00,0x00,0x00,0x1F}, // _
+};
+
+#define CELL_W 6
+#define CELL_H 8
+#define CELLS_PER_ROW (HUD_ATLAS_W/CELL_W)
+
+struct HudLine {
+	string text;
+	float x, y, scale, rgb[3];
+	vector<float> vertices;
+};
+
+static HudLine lines[HUD_LINES];
+static bool changed = true;
+
+/* Font index of a character : lower case as upper case, unknown as '?' */
+static int glyphOf (unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		c -= 'a'-'A';
+	return c >= 32 && c < 96 ? c-32 : '?'-32;
+}
+
+void hudBakeAtlas (unsigned char* pixels)
+{
+	memset(pixels, 0, HUD_ATLAS_W*HUD_ATLAS_H);
+	for (int g=0; g<64; g++) {
+		int cx = g%CELLS_PER_ROW*CELL_W, cy = g/CELLS_PER_ROW*CELL_H;
+		for (int row=0; row<HUD_GLYPH_H; row++)
+			for (int col=0; col<HUD_GLYPH_W; col++)
+				if (font[g][row] & (0x10 >> col))
+					pixels[(cy+row)*HUD_ATLAS_W + cx+col] = 255;
+	}
+}
+
+float hudTextWidth (const char* text, float scale)
+{
+	size_t n = strlen(text);
+	return n ? (n*HUD_ADVANCE - (HUD_ADVANCE-HUD_GLYPH_W))*scale : 0;
+}
+
+static void pushVertex (vector<float>& v, float x, float y, float u, float t, const float* rgb)
+{
+	float vertex[HUD_VERTEX_FLOATS] = { x, y, u, t, rgb[0], rgb[1], rgb[2] };
+	v.insert(v.end(), vertex, vertex+HUD_VERTEX_FLOATS);
+}
+
+/* Two triangles per visible glyph */
+static void layOut (HudLine& line)
+{
+	line.vertices.clear();
+	float w = HUD_GLYPH_W*line.scale, h = HUD_GLYPH_H*line.scale;
+	for (size_t i=0; i<line.text.size(); i++) {
+		int g = glyphOf(line.text[i]);
+		if (g == 0)
+			continue; // space
+		float x0 = line.x + i*HUD_ADVANCE*line.scale, y0 = line.y, x1 = x0+w, y1 = y0+h;
+		float u0 = (float)(g%CELLS_PER_ROW*CELL_W)/HUD_ATLAS_W, v0 = (float)(g/CELLS_PER_ROW*CELL_H)/HUD_ATLAS_H;
+		float u1 = u0 + (float)HUD_GLYPH_W/HUD_ATLAS_W, v1 = v0 + (float)HUD_GLYPH_H/HUD_ATLAS_H;
+		pushVertex(line.vertices, x0, y0, u0, v0, line.rgb);
+		pushVertex(line.vertices, x0, y1, u0, v1, line.rgb);
+		pushVertex(line.vertices, x1, y1, u1, v1, line.rgb);
+		pushVertex(line.vertices, x1, y1, u1, v1, line.rgb);
+		pushVertex(line.vertices, x1, y0, u1, v0, line.rgb);
+		pushVertex(line.vertices, x0, y0, u0, v0, line.rgb);
+	}
+}
+
+void hudSetLine (int line, const char* text, float x, float y, float scale, const float* rgb)
+{
+	if (line < 0 || line >= HUD_LINES)
+		return;
+	HudLine& l = lines[line];
+	if (l.text == text && l.x == x && l.y == y && l.scale == scale && !memcmp(l.rgb, rgb, sizeof l.rgb))
+		return;
+	l.text = text;
+	l.x = x;
+	l.y = y;
+	l.scale = scale;
+	memcpy(l.rgb, rgb, sizeof l.rgb);
+	layOut(l);
+	changed = true;
+}
+
+bool hudVertices (vector<float>& vertices)
+{
+	if (!changed)
+		return false;
+	vertices.clear();
+	for (int i=0; i<HUD_LINES; i++)
+		vertices.insert(vertices.end(), lines[i].vertices.begin(), lines[i].vertices.end());
+	changed = false;
+	return true;
+}
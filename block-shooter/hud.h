@@ -0,0 +1,39 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <vector>
+
+/* Heads-up text. A 5x7 pixel font (ASCII 32..95, lower case drawn as
+   upper case) is baked at startup into a one-channel atlas, and text is
+   laid out as textured quads, two triangles per glyph, in window pixels
+   with y pointing down. The HUD is a fixed set of lines, each keeping the
+   last text and placement given to it along with its laid-out vertices :
+   setting a line to what it already shows costs one string compare, and
+   only when some line changed are the vertices of all lines gathered
+   again, for one upload and one draw call. */
+
+#define HUD_LINES 8
+#define HUD_GLYPH_W 5
+#define HUD_GLYPH_H 7
+#define HUD_ADVANCE 6            // glyph width plus spacing, in font pixels
+#define HUD_ATLAS_W 96           // 16 cells of 6x8 pixels per row
+#define HUD_ATLAS_H 32           // 4 rows of cells
+#define HUD_VERTEX_FLOATS 7      // x, y, u, v, r, g, b
+
+/* Fill 'pixels' (HUD_ATLAS_W*HUD_ATLAS_H bytes, rows from the top) with
+   the font : 255 inside glyphs, 0 elsewhere */
+void hudBakeAtlas (unsigned char* pixels);
+
+/* Width in window pixels of 'text' drawn at 'scale' pixels per font pixel */
+float hudTextWidth (const char* text, float scale);
+
+/* Show 'text' on 'line' with its top left corner at (x, y), 'scale'
+   pixels per font pixel, in colour 'rgb' (0..1). "" hides the line */
+void hudSetLine (int line, const char* text, float x, float y, float scale, const float* rgb);
+
+/* If any line changed since the last call, replace 'vertices' with those
+   of every line (HUD_VERTEX_FLOATS each, triangles) and return true;
+   otherwise leave it alone and return false */
+bool hudVertices (std::vector<float>& vertices);
+
+#endif
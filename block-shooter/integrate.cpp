@@ -0,0 +1,103 @@
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+#include "integrate.h"
+
+/* Scalar versions also finish the tails the vector loops leave. The
+   attribute keeps GCC from vectorising them behind our back, so the
+   benchmark compares what it says it does */
+__attribute__((optimize("no-tree-vectorize")))
+void integrateFallScalar (float* y, int n, float dy)
+{
+	int i;
+	for(i=0;i<n;i++)
+		y[i] -= dy;
+}
+
+__attribute__((optimize("no-tree-vectorize")))
+void integrateBulletsScalar (float* x, float* y, const float* vx, const float* vy, int n)
+{
+	int i;
+	for(i=0;i<n;i++)
+	{
+		x[i] += vx[i];
+		y[i] += vy[i];
+	}
+}
+
+__attribute__((optimize("no-tree-vectorize")))
+void integrateParticlesScalar (float* x, float* y, const float* vx, float* vy, float* alpha, const float* fade, int n, float g)
+{
+	int i;
+	for(i=0;i<n;i++)
+	{
+		x[i] += vx[i];
+		y[i] += vy[i];
+		vy[i] -= g;
+		alpha[i] -= fade[i];
+	}
+}
+
+void integrateFall (float* y, int n, float dy)
+{
+	int i = 0;
+#if defined(__AVX__)
+	__m256 d8 = _mm256_set1_ps(dy);
+	for(;i+8<=n;i+=8)
+		_mm256_storeu_ps(y+i, _mm256_sub_ps(_mm256_loadu_ps(y+i), d8));
+#endif
+#if defined(__SSE__)
+	__m128 d4 = _mm_set1_ps(dy);
+	for(;i+4<=n;i+=4)
+		_mm_storeu_ps(y+i, _mm_sub_ps(_mm_loadu_ps(y+i), d4));
+#endif
+	integrateFallScalar(y+i, n-i, dy);
+}
+
+void integrateBullets (float* x, float* y, const float* vx, const float* vy, int n)
+{
+	int i = 0;
+#if defined(__AVX__)
+	for(;i+8<=n;i+=8)
+	{
+		_mm256_storeu_ps(x+i, _mm256_add_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(vx+i)));
+		_mm256_storeu_ps(y+i, _mm256_add_ps(_mm256_loadu_ps(y+i), _mm256_loadu_ps(vy+i)));
+	}
+#endif
+#if defined(__SSE__)
+	for(;i+4<=n;i+=4)
+	{
+		_mm_storeu_ps(x+i, _mm_add_ps(_mm_loadu_ps(x+i), _mm_loadu_ps(vx+i)));
+		_mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), _mm_loadu_ps(vy+i)));
+	}
+#endif
+	integrateBulletsScalar(x+i, y+i, vx+i, vy+i, n-i);
+}
+
+void integrateParticles (float* x, float* y, const float* vx, float* vy, float* alpha, const float* fade, int n, float g)
+{
+	int i = 0;
+#if defined(__AVX__)
+	__m256 g8 = _mm256_set1_ps(g);
+	for(;i+8<=n;i+=8)
+	{
+		__m256 v = _mm256_loadu_ps(vy+i);
+		_mm256_storeu_ps(x+i, _mm256_add_ps(_mm256_loadu_ps(x+i), _mm256_loadu_ps(vx+i)));
+		_mm256_storeu_ps(y+i, _mm256_add_ps(_mm256_loadu_ps(y+i), v));
+		_mm256_storeu_ps(vy+i, _mm256_sub_ps(v, g8));
+		_mm256_storeu_ps(alpha+i, _mm256_sub_ps(_mm256_loadu_ps(alpha+i), _mm256_loadu_ps(fade+i)));
+	}
+#endif
+#if defined(__SSE__)
+	__m128 g4 = _mm_set1_ps(g);
+	for(;i+4<=n;i+=4)
+	{
+		__m128 v = _mm_loadu_ps(vy+i);
+		_mm_storeu_ps(x+i, _mm_add_ps(_mm_loadu_ps(x+i), _mm_loadu_ps(vx+i)));
+		_mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), v));
+		_mm_storeu_ps(vy+i, _mm_sub_ps(v, g4));
+		_mm_storeu_ps(alpha+i, _mm_sub_ps(_mm_loadu_ps(alpha+i), _mm_loadu_ps(fade+i)));
+	}
+#endif
+	integrateParticlesScalar(x+i, y+i, vx+i, vy+i, alpha+i, fade+i, n-i, g);
+}
@@ -0,0 +1,27 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+/* Position integration over the SoA pool columns, one fixed step at a
+   time. Every entity moves by a displacement known in advance, so a step
+   is a single add per coordinate : no sin/cos, no multiply, and no chance
+   for the compiler to fuse a multiply-add in one path and not the other.
+   The SIMD and scalar versions therefore give bit-identical results,
+   which replays rely on. AVX is used when the build enables it (-mavx),
+   SSE otherwise, and plain C++ on other targets. */
+
+/* y[i] -= dy for i in [0, n) : falling blocks */
+void integrateFall (float* y, int n, float dy);
+
+/* x[i] += vx[i], y[i] += vy[i] for i in [0, n) : bullets */
+void integrateBullets (float* x, float* y, const float* vx, const float* vy, int n);
+
+/* x[i] += vx[i], y[i] += vy[i], vy[i] -= g, alpha[i] -= fade[i] for
+   i in [0, n) : particles under gravity, fading */
+void integrateParticles (float* x, float* y, const float* vx, float* vy, float* alpha, const float* fade, int n, float g);
+
+/* The same without SIMD, for targets without it and for benchmarking */
+void integrateFallScalar (float* y, int n, float dy);
+void integrateBulletsScalar (float* x, float* y, const float* vx, const float* vy, int n);
+void integrateParticlesScalar (float* x, float* y, const float* vx, float* vy, float* alpha, const float* fade, int n, float g);
+
+#endif
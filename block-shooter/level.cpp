@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "level.h"
+#include "files.h"
+#include "entity_pool.h"
+#include "game.h"
+
+using namespace std;
+
+static bool parseColour (const char* name, int& colour)
+{
+	if (!strcmp(name, "red")) colour = BLOCK_RED;
+	else if (!strcmp(name, "green")) colour = BLOCK_GREEN;
+	else if (!strcmp(name, "black")) colour = BLOCK_BLACK;
+	else return false;
+	return true;
+}
+
+/* Parse the level text. Lines are "<keyword> <values>", '#' starts a
+   comment; see levels/default.txt */
+static bool parseLevel (const char* path, const string& text, LevelHeader& header,
+		vector<LevelMirror>& mirrors, vector<LevelBucket>& buckets, vector<LevelSpawn>& spawns)
+{
+	float period = 50.0f/60; // seconds
+	float spawn_x[2] = { -2.8f, 4.0f };
+	header.gun_x = -3.75f;
+	header.speed = 1.8f;
+	header.spawn_y = 4.5f;
+
+	size_t pos = 0;
+	int lineno = 0;
+	while (pos < text.size()) {
+		size_t end = text.find('\n', pos);
+		if (end == string::npos)
+			end = text.size();
+		string line = text.substr(pos, end-pos);
+		pos = end+1;
+		lineno++;
+		size_t hash = line.find('#');
+		if (hash != string::npos)
+			line.resize(hash);
+
+		char key[32], name[32];
+		int n;
+		if (sscanf(line.c_str(), "%31s%n", key, &n) != 1)
+			continue;
+		const char* rest = line.c_str()+n;
+		bool ok;
+		if (!strcmp(key, "gun"))
+			ok = sscanf(rest, "%f", &header.gun_x) == 1;
+		else if (!strcmp(key, "speed"))
+			ok = sscanf(rest, "%f", &header.speed) == 1;
+		else if (!strcmp(key, "spawn_period"))
+			ok = sscanf(rest, "%f", &period) == 1 && period > 0;
+		else if (!strcmp(key, "spawn_x"))
+			// x is picked in hundredths : the range must hold at least one
+			ok = sscanf(rest, "%f %f", &spawn_x[0], &spawn_x[1]) == 2 && lround(spawn_x[1]*100) > lround(spawn_x[0]*100);
+		else if (!strcmp(key, "spawn_y"))
+			ok = sscanf(rest, "%f", &header.spawn_y) == 1;
+		else if (!strcmp(key, "mirror")) {
+			LevelMirror m;
+			ok = sscanf(rest, "%f %f %f %f", &m.cx, &m.cy, &m.angle, &m.half) == 4 && m.half > 0;
+			if (ok)
+				mirrors.push_back(m);
+		}
+		else if (!strcmp(key, "bucket")) {
+			LevelBucket b;
+			ok = sscanf(rest, "%f %f %31s", &b.x, &b.y, name) == 3 && parseColour(name, b.colour) && b.colour != BLOCK_BLACK;
+			if (ok)
+				buckets.push_back(b);
+		}
+		else if (!strcmp(key, "spawn")) {
+			LevelSpawn s;
+			ok = sscanf(rest, "%31s %d", name, &s.weight) == 2 && parseColour(name, s.colour) && s.weight >= 0;
+			if (ok)
+				spawns.push_back(s);
+		}
+		else {
+			fprintf(stderr, "%s:%d: unknown keyword '%s'\n", path, lineno, key);
+			return false;
+		}
+		if (!ok) {
+			fprintf(stderr, "%s:%d: bad '%s' line\n", path, lineno, key);
+			return false;
+		}
+	}
+
+	int total = 0;
+	for (size_t i=0; i<spawns.size(); i++)
+		total += spawns[i].weight;
+	if (total == 0) {
+		fprintf(stderr, "%s: no spawn line with a weight\n", path);
+		return false;
+	}
+	header.spawn_period = max(1, (int)lround(period*SIM_HZ));
+	header.spawn_x_min = (int)lround(spawn_x[0]*100);
+	header.spawn_x_steps = (int)lround(spawn_x[1]*100)-header.spawn_x_min;
+	return true;
+}
+
+/* Compile 'text' into the blob at 'path' */
+static bool compileLevel (const char* source, const string& text, const char* path)
+{
+	LevelHeader header;
+	memset(&header, 0, sizeof header);
+	vector<LevelMirror> mirrors;
+	vector<LevelBucket> buckets;
+	vector<LevelSpawn> spawns;
+	if (!parseLevel(source, text, header, mirrors, buckets, spawns))
+		return false;
+	memcpy(header.magic, "BSLV", 4);
+	header.version = LEVEL_VERSION;
+	header.source_hash = fnv1a(text.data(), text.size());
+	header.mirrors = mirrors.size();
+	header.buckets = buckets.size();
+	header.spawns = spawns.size();
+
+	AtomicFile file;
+	if (!atomicOpen(file, path))
+		return false;
+	fwrite(&header, sizeof header, 1, file.f);
+	fwrite(mirrors.data(), sizeof(LevelMirror), mirrors.size(), file.f);
+	fwrite(buckets.data(), sizeof(LevelBucket), buckets.size(), file.f);
+	fwrite(spawns.data(), sizeof(LevelSpawn), spawns.size(), file.f);
+	if (!atomicCommit(file)) {
+		fprintf(stderr, "Cannot compile %s\n", source);
+		return false;
+	}
+	return true;
+}
+
+/* Map a blob and check it is complete, of this version and made from
+   the text hashing to 'hash' */
+static bool mapCompiled (const char* path, unsigned long long hash, Level& level)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* map = NULL;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(LevelHeader)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			map = NULL;
+	}
+	close(fd);
+	if (map == NULL)
+		return false;
+	size_t size = st.st_size;
+	const LevelHeader* header = (const LevelHeader*)map;
+	if (memcmp(header->magic, "BSLV", 4) || header->version != LEVEL_VERSION || header->source_hash != hash
+			|| size != sizeof *header + header->mirrors*sizeof(LevelMirror)
+				+ header->buckets*sizeof(LevelBucket) + header->spawns*sizeof(LevelSpawn)) {
+		munmap(map, size);
+		return false;
+	}
+	level.header = header;
+	level.mirrors = (const LevelMirror*)(header+1);
+	level.buckets = (const LevelBucket*)(level.mirrors+header->mirrors);
+	level.spawns = (const LevelSpawn*)(level.buckets+header->buckets);
+	level.map = map;
+	level.map_size = size;
+	return true;
+}
+
+bool levelLoad (const char* source, Level& level)
+{
+	string text;
+	if (!readText(source, text)) {
+		fprintf(stderr, "Cannot read %s\n", source);
+		return false;
+	}
+	unsigned long long hash = fnv1a(text.data(), text.size());
+	// levels/x.txt -> levels/x.lvl
+	string path = source;
+	size_t dot = path.rfind('.');
+	if (dot != string::npos && path.find('/', dot) == string::npos)
+		path.resize(dot);
+	path += ".lvl";
+	if (mapCompiled(path.c_str(), hash, level))
+		return true;
+	return compileLevel(source, text, path.c_str()) && mapCompiled(path.c_str(), hash, level);
+}
+
+void levelRelease (Level& level)
+{
+	if (level.map)
+		munmap(level.map, level.map_size);
+	level.map = NULL;
+	level.header = NULL;
+	level.mirrors = NULL;
+	level.buckets = NULL;
+	level.spawns = NULL;
+}
@@ -0,0 +1,66 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <cstddef>
+
+/* Levels : the gun, mirrors, buckets and block spawning, described in a
+   text file (see levels/default.txt for the syntax) so layouts change
+   without rebuilding. The text is compiled once into a binary blob next
+   to it (levels/x.txt -> levels/x.lvl) which later loads simply map;
+   the blob records a hash of the text it came from, so editing the text
+   recompiles it on the next load.
+
+   Blob layout:
+     LevelHeader, then 'mirrors' LevelMirror, 'buckets' LevelBucket and
+     'spawns' LevelSpawn records, every field 4 bytes wide. */
+
+#define LEVEL_VERSION 1
+#define LEVEL_DEFAULT "levels/default.txt"
+
+struct LevelHeader {
+	char magic[4];               // "BSLV"
+	unsigned int version;
+	unsigned long long source_hash; // FNV-1a of the text
+	float gun_x;                 // where the gun turns
+	float speed;                 // block fall speed at the start, units/s
+	float spawn_y;               // height blocks appear at
+	int spawn_period;            // simulation steps between blocks
+	int spawn_x_min;             // blocks appear at x in hundredths of a
+	int spawn_x_steps;           // unit : min + [0, steps)
+	unsigned int mirrors, buckets, spawns;
+};
+
+struct LevelMirror {
+	float cx, cy, angle, half;   // centre, degrees, half length
+};
+
+struct LevelBucket {
+	float x, y;                  // centre
+	int colour;                  // BlockColour it collects
+};
+
+struct LevelSpawn {
+	int colour;                  // BlockColour
+	int weight;                  // relative odds of this colour
+};
+
+/* A loaded level : pointers into the mapped blob */
+struct Level {
+	const LevelHeader* header;
+	const LevelMirror* mirrors;
+	const LevelBucket* buckets;
+	const LevelSpawn* spawns;
+
+	void* map;
+	size_t map_size;
+};
+
+/* Map the compiled form of 'source', compiling it first if the blob is
+   missing or stale. False (with "file:line: message" for syntax errors)
+   on any failure, leaving 'level' untouched */
+bool levelLoad (const char* source, Level& level);
+
+/* Unmap a level returned by levelLoad */
+void levelRelease (Level& level);
+
+#endif
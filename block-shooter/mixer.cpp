@@ -0,0 +1,193 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "mixer.h"
+#include "spsc_queue.h"
+
+using namespace std;
+
+struct Voice {
+	int sound;                // -1 when free
+	size_t pos;               // next frame of the sound
+	unsigned long long start; // trigger order, to steal the oldest
+};
+
+static vector<MixerSound> sounds;
+static Voice voices[MIXER_VOICES];
+static unsigned long long voice_serial = 0;
+static SPSCQueue<int> triggers;
+struct SoundSwap {
+	int id;
+	MixerSound sound;
+};
+static SPSCQueue<SoundSwap> swaps;
+static vector<int> acc;       // one period of 32-bit sums
+static int out_channels = 2;
+static atomic<int> active_voices(0);
+
+void mixerInit (int channels, int max_frames)
+{
+	out_channels = channels;
+	acc.assign(max_frames*channels, 0);
+	triggers.init(MIXER_QUEUE);
+	swaps.init(MIXER_QUEUE);
+	for (int v=0; v<MIXER_VOICES; v++)
+		voices[v].sound = -1;
+}
+
+int mixerAddSound (const MixerSound& sound)
+{
+	if (sound.channels != 1 && sound.channels != out_channels) {
+		fprintf(stderr, "Sound with %d channels cannot be mixed into %d\n", sound.channels, out_channels);
+		return -1;
+	}
+	sounds.push_back(sound);
+	return sounds.size()-1;
+}
+
+void mixerReplaceSound (int id, const MixerSound& sound)
+{
+	if (id < 0 || (sound.channels != 1 && sound.channels != out_channels))
+		return;
+	SoundSwap swap = { id, sound };
+	swaps.push(swap);
+}
+
+void mixerTrigger (int id)
+{
+	if (id >= 0)
+		triggers.push(id);
+}
+
+int mixerActiveVoices ()
+{
+	return active_voices.load();
+}
+
+/* Take a free voice, or the one playing the longest */
+static void startVoice (int sound)
+{
+	int best = 0;
+	for (int v=0; v<MIXER_VOICES; v++) {
+		if (voices[v].sound < 0) {
+			best = v;
+			break;
+		}
+		if (voices[v].start < voices[best].start)
+			best = v;
+	}
+	voices[best].sound = sound;
+	voices[best].pos = 0;
+	voices[best].start = voice_serial++;
+}
+
+void mixAccumulate (int* acc, const short* src, int n, int gain)
+{
+	int i = 0;
+#ifdef __SSE2__
+	// madd of (x, 0) pairs with (gain, 0) pairs widens and scales in one go
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i g = _mm_set1_epi32(gain & 0xFFFF);
+	for (; i+8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(x, zero), g), 15);
+		__m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(x, zero), g), 15);
+		_mm_storeu_si128((__m128i*)(acc+i), _mm_add_epi32(_mm_loadu_si128((__m128i*)(acc+i)), lo));
+		_mm_storeu_si128((__m128i*)(acc+i+4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(acc+i+4)), hi));
+	}
+#endif
+	for (; i < n; i++)
+		acc[i] += (src[i]*gain) >> 15;
+}
+
+void mixAccumulateMonoToStereo (int* acc, const short* src, int frames, int gain)
+{
+	int i = 0;
+#ifdef __SSE2__
+	// unpacking a vector with itself duplicates every sample into L and R
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i g = _mm_set1_epi32(gain & 0xFFFF);
+	for (; i+8 <= frames; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d[2] = { _mm_unpacklo_epi16(x, x), _mm_unpackhi_epi16(x, x) };
+		for (int k=0; k<2; k++) {
+			int* a = acc + 2*i + 8*k;
+			__m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(d[k], zero), g), 15);
+			__m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(d[k], zero), g), 15);
+			_mm_storeu_si128((__m128i*)a, _mm_add_epi32(_mm_loadu_si128((__m128i*)a), lo));
+			_mm_storeu_si128((__m128i*)(a+4), _mm_add_epi32(_mm_loadu_si128((__m128i*)(a+4)), hi));
+		}
+	}
+#endif
+	for (; i < frames; i++) {
+		int s = (src[i]*gain) >> 15;
+		acc[2*i] += s;
+		acc[2*i+1] += s;
+	}
+}
+
+void mixClip (const int* acc, short* out, int n)
+{
+	int i = 0;
+#ifdef __SSE2__
+	// packs saturates to the int16 range, which is exactly the clip
+	for (; i+8 <= n; i += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(acc+i));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(acc+i+4));
+		_mm_storeu_si128((__m128i*)(out+i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = acc[i] > 32767 ? 32767 : (acc[i] < -32768 ? -32768 : acc[i]);
+}
+
+void mixerRender (const short* music, short* out, int frames)
+{
+	int id, n = frames*out_channels, active = 0;
+	SoundSwap swap;
+	while (swaps.pop(swap)) {
+		sounds[swap.id] = swap.sound;
+		for (int v=0; v<MIXER_VOICES; v++)
+			if (voices[v].sound == swap.id)
+				voices[v].sound = -1;
+	}
+	while (triggers.pop(id))
+		startVoice(id);
+
+	int* a = &acc[0];
+	if (music)
+		for (int i=0; i<n; i++)
+			a[i] = music[i];
+	else
+		memset(a, 0, n*sizeof(int));
+
+	for (int v=0; v<MIXER_VOICES; v++) {
+		Voice& voice = voices[v];
+		if (voice.sound < 0)
+			continue;
+		const MixerSound& s = sounds[voice.sound];
+		int count = s.frames - voice.pos;
+		if (count > frames)
+			count = frames;
+		const short* src = s.samples + voice.pos*s.channels;
+		if (s.channels == out_channels)
+			mixAccumulate(a, src, count*out_channels, s.gain);
+		else if (out_channels == 2)
+			mixAccumulateMonoToStereo(a, src, count, s.gain);
+		else
+			for (int f=0; f<count; f++)
+				for (int c=0; c<out_channels; c++)
+					a[f*out_channels+c] += (src[f]*s.gain) >> 15;
+		voice.pos += count;
+		if (voice.pos >= s.frames)
+			voice.sound = -1;
+		else
+			active++;
+	}
+	mixClip(a, out, n);
+	active_voices.store(active);
+}
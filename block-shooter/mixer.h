@@ -0,0 +1,57 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <cstddef>
+
+/* Software mixer for sound effects over the music.
+   Sounds are registered once at startup; after that mixerTrigger() may be
+   called from the game thread at any time and only pushes the sound id
+   onto a lock-free queue. The audio thread calls mixerRender() once per
+   period : it starts the queued sounds on free voices from a fixed pool
+   (stealing the oldest voice when all are busy), sums music and voices in
+   32 bits and saturates back to 16 bits. Nothing on the audio thread
+   allocates or locks, and a trigger is heard at the latest one period
+   later. Mixing and clipping use SSE2 where available. */
+
+#define MIXER_VOICES 16
+#define MIXER_QUEUE 64   // triggers buffered between two periods
+
+struct MixerSound {
+	const short* samples;  // interleaved, mono or the output channel count
+	size_t frames;
+	int channels;
+	int gain;              // Q15, 32767 is unity
+};
+
+/* Preallocate for 'channels' output channels and periods of up to
+   'max_frames' frames. Call before the audio thread starts */
+void mixerInit (int channels, int max_frames);
+
+/* Register a sound, returns its id. Call before the audio thread starts;
+   the samples must stay valid while the mixer runs */
+int mixerAddSound (const MixerSound& sound);
+
+/* Swap the samples of sound 'id' for others, from the next period on;
+   voices playing it stop. The old samples must stay valid until then,
+   which the caller cannot observe, so they are best kept until the mixer
+   stops. Call from one thread only (asset reloading); dropped if more
+   than MIXER_QUEUE swaps are pending */
+void mixerReplaceSound (int id, const MixerSound& sound);
+
+/* Game thread : play sound 'id' from the next period on. Dropped if more
+   than MIXER_QUEUE triggers are pending */
+void mixerTrigger (int id);
+
+/* Audio thread : mix 'frames' frames of 'music' (NULL for silence) with
+   the playing voices into 'out' */
+void mixerRender (const short* music, short* out, int frames);
+
+/* Voices still playing, as last seen by the audio thread */
+int mixerActiveVoices ();
+
+/* Kernels, exposed for benchmarking. n counts samples, not frames */
+void mixAccumulate (int* acc, const short* src, int n, int gain);
+void mixAccumulateMonoToStereo (int* acc, const short* src, int frames, int gain);
+void mixClip (const int* acc, short* out, int n);
+
+#endif
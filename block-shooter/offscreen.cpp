@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <vector>
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "offscreen.h"
+#include "files.h"
+
+using namespace std;
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static GLuint framebuffer, renderbuffers[2]; // colour, depth
+static int frame_width, frame_height;
+static vector<unsigned char> pixels;         // last frame read back, RGB
+
+/* The surfaceless platform needs no window system at all; without it,
+   the default display still works where a window system is around */
+static EGLDisplay openDisplay ()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay d = EGL_NO_DISPLAY;
+	if (getPlatformDisplay)
+		d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (d == EGL_NO_DISPLAY)
+		d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	return d;
+}
+
+bool offscreenStart (int width, int height)
+{
+	EGLint major, minor;
+	display = openDisplay();
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		fprintf(stderr, "Cannot open an EGL display\n");
+		return false;
+	}
+	// no config and no surface : the framebuffer object is the target
+	static const EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	if (eglBindAPI(EGL_OPENGL_API))
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		fprintf(stderr, "Cannot create a surfaceless GL 3.3 core context (EGL %d.%d)\n", major, minor);
+		offscreenStop();
+		return false;
+	}
+	// glewInit() would also want a GLX display; the GL entry points are
+	// all this needs
+	glewExperimental = GL_TRUE;
+	if (glewContextInit() != GLEW_OK) {
+		fprintf(stderr, "Cannot load the GL entry points\n");
+		offscreenStop();
+		return false;
+	}
+
+	frame_width = width;
+	frame_height = height;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Cannot render offscreen at %dx%d\n", width, height);
+		offscreenStop();
+		return false;
+	}
+	glViewport(0, 0, width, height);
+	return true;
+}
+
+void offscreenPresent ()
+{
+	glFinish();
+}
+
+static void readFrame ()
+{
+	pixels.resize(3*frame_width*frame_height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, frame_width, frame_height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+}
+
+unsigned long long offscreenHash ()
+{
+	readFrame();
+	return fnv1a(&pixels[0], pixels.size());
+}
+
+bool offscreenDump (const char* path)
+{
+	readFrame();
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return false;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", frame_width, frame_height);
+	// GL rows go bottom up, PPM rows top down
+	for (int y=frame_height-1; y>=0; y--)
+		fwrite(&pixels[3*y*frame_width], 1, 3*frame_width, f);
+	bool ok = !ferror(f);
+	ok = fclose(f) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "Cannot write %s\n", path);
+	return ok;
+}
+
+void offscreenStop ()
+{
+	if (context != EGL_NO_CONTEXT) {
+		if (framebuffer) {
+			glDeleteRenderbuffers(2, renderbuffers);
+			glDeleteFramebuffers(1, &framebuffer);
+			framebuffer = 0;
+		}
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+		context = EGL_NO_CONTEXT;
+	}
+	if (display != EGL_NO_DISPLAY)
+		eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+}
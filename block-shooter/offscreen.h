@@ -0,0 +1,30 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+/* Rendering without a window, for build hosts without a display or GPU.
+   An EGL context on Mesa's surfaceless platform (llvmpipe when there is
+   no GPU) draws into a framebuffer object of a fixed size, which stays
+   bound as the default target, so draw() runs unchanged. Nothing is ever
+   swapped and there is no swap interval : frames go as fast as the
+   renderer allows. A finished frame can be hashed or dumped for golden
+   image comparison. Frames are only comparable on the same driver build,
+   since rasterisation details differ between Mesa versions. */
+
+/* Create the context and the framebuffer, make them current and load
+   the GL entry points through GLEW. False (with a message) if EGL cannot
+   give a GL 3.3 core context */
+bool offscreenStart (int width, int height);
+
+/* Wait for the frame to be rendered, as a swap would */
+void offscreenPresent ();
+
+/* FNV-1a 64 over the frame's RGB pixels, bottom row first */
+unsigned long long offscreenHash ();
+
+/* Write the frame as a binary PPM, top row first */
+bool offscreenDump (const char* path);
+
+/* Destroy the framebuffer and the context */
+void offscreenStop ();
+
+#endif
@@ -0,0 +1,92 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "particles.h"
+#include "integrate.h"
+#include "game.h"
+
+using namespace std;
+
+/* Uniform in [0, 1), xorshift32 : quality hardly matters for sparks */
+static float particleRand (ParticlePool& pool)
+{
+	pool.rng ^= pool.rng << 13;
+	pool.rng ^= pool.rng >> 17;
+	pool.rng ^= pool.rng << 5;
+	return (pool.rng >> 8) * (1.0f/16777216);
+}
+
+void emitBurst (ParticlePool& pool, float x, float y, int count, float speed, float seconds, const float* rgb)
+{
+	if (count > PARTICLE_CAPACITY - pool.count)
+		count = PARTICLE_CAPACITY - pool.count;
+	for (int k=0; k<count; k++) {
+		int i = pool.count++;
+		float a = particleRand(pool) * 2*M_PI;
+		// slower particles more often, so bursts look dense in the middle
+		float v = speed*SIM_DT * (0.15f + 0.85f*particleRand(pool)*particleRand(pool));
+		pool.x[i] = x;
+		pool.y[i] = y;
+		pool.vx[i] = v*cosf(a);
+		pool.vy[i] = v*sinf(a);
+		pool.alpha[i] = 1;
+		pool.fade[i] = 1/(seconds*SIM_HZ*(0.5f + 0.5f*particleRand(pool)));
+		for (int c=0; c<3; c++)
+			pool.colour[i][c] = (unsigned char)(rgb[c]*255 + 0.5f);
+	}
+}
+
+void stepParticles (ParticlePool& pool)
+{
+	integrateParticles(pool.x, pool.y, pool.vx, pool.vy, pool.alpha, pool.fade, pool.count, PARTICLE_GRAVITY*SIM_DT*SIM_DT);
+	// going downwards, swap-and-pop only ever moves a particle already kept
+	for (int i=pool.count-1; i>=0; i--) {
+		if (pool.alpha[i] > 0)
+			continue;
+		int last = --pool.count;
+		pool.x[i] = pool.x[last];
+		pool.y[i] = pool.y[last];
+		pool.vx[i] = pool.vx[last];
+		pool.vy[i] = pool.vy[last];
+		pool.alpha[i] = pool.alpha[last];
+		pool.fade[i] = pool.fade[last];
+		for (int c=0; c<3; c++)
+			pool.colour[i][c] = pool.colour[last][c];
+	}
+}
+
+void splatParticles (const ParticlePool& pool, ParticleImage& image, const float* background)
+{
+	const int n = PARTICLE_IMAGE_TEXELS;
+	const float scale = n/PARTICLE_IMAGE_SPAN;
+	if (image.row_lo < image.row_hi)
+		memset(&image.texels[image.row_lo*n], 0, (image.row_hi-image.row_lo)*n*sizeof(unsigned int));
+	float bg[3];
+	for (int c=0; c<3; c++)
+		bg[c] = background[c]*255;
+	int lo = n, hi = 0, painted = 0;
+	for (int i=0; i<pool.count; i++) {
+		// the square's first texel, so that it is centred on the particle
+		int tx = (int)floorf((pool.x[i]-PARTICLE_IMAGE_MIN)*scale - 0.5f*PARTICLE_SPLAT);
+		int ty = (int)floorf((pool.y[i]-PARTICLE_IMAGE_MIN)*scale - 0.5f*PARTICLE_SPLAT);
+		if (tx < 0 || ty < 0 || tx > n-PARTICLE_SPLAT || ty > n-PARTICLE_SPLAT)
+			continue;
+		float a = pool.alpha[i];
+		unsigned char rgba[4];
+		for (int c=0; c<3; c++)
+			rgba[c] = (unsigned char)(bg[c] + (pool.colour[i][c]-bg[c])*a + 0.5f);
+		rgba[3] = 255;
+		unsigned int texel;
+		memcpy(&texel, rgba, sizeof texel);
+		unsigned int* row = &image.texels[ty*n + tx];
+		for (int r=0; r<PARTICLE_SPLAT; r++, row += n)
+			for (int c=0; c<PARTICLE_SPLAT; c++)
+				row[c] = texel;
+		lo = min(lo, ty);
+		hi = max(hi, ty+PARTICLE_SPLAT);
+		painted++;
+	}
+	image.row_lo = painted ? lo : 0;
+	image.row_hi = painted ? hi : 0;
+	image.count = painted;
+}
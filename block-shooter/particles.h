@@ -0,0 +1,65 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+/* Particle bursts for hits, catches, mirror bounces and game over.
+   Particles live in fixed-capacity structure-of-arrays columns that are
+   part of the pool itself, so emitting never allocates : a burst that
+   does not fit is cut short. A step moves every particle in one SIMD
+   pass (integrateParticles), then retires the faded ones by swap-and-pop
+   as the entity pools do. They are purely cosmetic, drawn from their own
+   random stream and never read by the game, so the simulation, replays
+   and stateHash() do not see them. */
+
+#include <vector>
+
+#define PARTICLE_CAPACITY 65536
+#define PARTICLE_GRAVITY 3.0f     // units per second squared
+
+/* Particles are drawn as one texture over the playfield rather than as a
+   primitive each : on software GL (llvmpipe) every point costs its own
+   primitive setup, about 0.3 us, so 50000 of them missed a 60 Hz frame
+   however cheaply their data was uploaded. splatParticles() paints them
+   into a world-space image instead, and the renderer uploads only the
+   rows that changed and draws a single quad. Each particle is a square
+   of PARTICLE_SPLAT texels; particles outside the image are not drawn */
+#define PARTICLE_IMAGE_MIN -5.0f   // the image covers MIN..MIN+SPAN on both axes
+#define PARTICLE_IMAGE_SPAN 10.0f
+#define PARTICLE_IMAGE_TEXELS 640  // per side, 64 per unit
+#define PARTICLE_SPLAT 3           // texels per side of a particle, about 0.05 units
+
+struct ParticleImage {
+	std::vector<unsigned int> texels; // RGBA8, row 0 at y = MIN; alpha 0 where empty
+	int row_lo, row_hi;               // rows holding particles, [row_lo, row_hi)
+	int count;                        // particles painted
+
+	ParticleImage () : texels(PARTICLE_IMAGE_TEXELS*PARTICLE_IMAGE_TEXELS, 0), row_lo(0), row_hi(0), count(0) {}
+};
+
+struct ParticlePool {
+	alignas(32) float x[PARTICLE_CAPACITY];
+	alignas(32) float y[PARTICLE_CAPACITY];
+	alignas(32) float vx[PARTICLE_CAPACITY];    // displacement per step
+	alignas(32) float vy[PARTICLE_CAPACITY];
+	alignas(32) float alpha[PARTICLE_CAPACITY]; // 1 when emitted, gone at 0
+	alignas(32) float fade[PARTICLE_CAPACITY];  // alpha lost per step
+	unsigned char colour[PARTICLE_CAPACITY][3];
+	int count;
+	unsigned int rng;
+
+	ParticlePool () : count(0), rng(0x9E3779B9u) {}
+};
+
+/* Emit up to 'count' particles from (x, y), flying out in every direction
+   at up to 'speed' units per second and fading out over up to 'seconds'.
+   'rgb' is the colour in 0..1 */
+void emitBurst (ParticlePool& pool, float x, float y, int count, float speed, float seconds, const float* rgb);
+
+/* Advance every particle by one simulation step (SIM_DT) */
+void stepParticles (ParticlePool& pool);
+
+/* Paint every live particle into 'image', its colour mixed towards
+   'background' as it fades, after clearing what the image held before.
+   Only the rows painted last time are cleared */
+void splatParticles (const ParticlePool& pool, ParticleImage& image, const float* background);
+
+#endif
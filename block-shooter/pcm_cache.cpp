@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mpg123.h>
+#include "pcm_cache.h"
+#include "files.h"
+
+using namespace std;
+
+struct PCMHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int rate;
+	unsigned int channels;
+	unsigned long long frames;
+};
+
+/* Map a whole file read-only; NULL if it cannot be opened or is empty */
+static void* mapFile (const char* path, size_t& size)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	void* map = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		size = st.st_size;
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			map = NULL;
+	}
+	close(fd);
+	return map;
+}
+
+/* FNV-1a 64 of the source file's bytes, the cache key */
+static bool hashFile (const char* path, unsigned long long& hash)
+{
+	size_t size;
+	const unsigned char* p = (const unsigned char*)mapFile(path, size);
+	if (p == NULL)
+		return false;
+	hash = fnv1a(p, size);
+	munmap((void*)p, size);
+	return true;
+}
+
+/* Decode 'source' into the cache entry 'path' */
+static bool decodeToCache (const char* source, const char* path)
+{
+	int err, channels, encoding;
+	long rate;
+	mpg123_handle* mh = mpg123_new(NULL, &err);
+	if (mh == NULL || mpg123_open(mh, source) != MPG123_OK || mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK) {
+		fprintf(stderr, "Cannot decode %s\n", source);
+		if (mh)
+			mpg123_delete(mh);
+		return false;
+	}
+	mpg123_format_none(mh);
+	mpg123_format(mh, rate, channels, MPG123_ENC_SIGNED_16);
+
+	AtomicFile file;
+	if (!atomicOpen(file, path)) {
+		mpg123_close(mh);
+		mpg123_delete(mh);
+		return false;
+	}
+
+	PCMHeader header;
+	memcpy(header.magic, "BSPC", 4);
+	header.version = PCM_CACHE_VERSION;
+	header.rate = rate;
+	header.channels = channels;
+	header.frames = 0;
+	fwrite(&header, sizeof header, 1, file.f);
+
+	vector<unsigned char> chunk(mpg123_outblock(mh));
+	unsigned long long bytes = 0;
+	size_t done;
+	while (1) {
+		err = mpg123_read(mh, &chunk[0], chunk.size(), &done);
+		fwrite(&chunk[0], 1, done, file.f);
+		bytes += done;
+		if (err != MPG123_OK && err != MPG123_NEW_FORMAT)
+			break;
+	}
+	mpg123_close(mh);
+	mpg123_delete(mh);
+
+	header.frames = bytes/(sizeof(short)*channels);
+	bool ok = err == MPG123_DONE && header.frames > 0;
+	if (ok) {
+		fseek(file.f, 0, SEEK_SET);
+		fwrite(&header, sizeof header, 1, file.f);
+	}
+	if (!atomicCommit(file, ok)) {
+		fprintf(stderr, "Cannot cache %s\n", source);
+		return false;
+	}
+	return true;
+}
+
+/* Map a cache entry and check it is complete and of this version */
+static bool mapCached (const char* path, PCMAsset& asset)
+{
+	size_t size;
+	void* map = mapFile(path, size);
+	if (map == NULL)
+		return false;
+	const PCMHeader* header = (const PCMHeader*)map;
+	if (size < sizeof *header || memcmp(header->magic, "BSPC", 4) || header->version != PCM_CACHE_VERSION
+			|| header->channels == 0 || header->frames == 0
+			|| size != sizeof *header + header->frames*header->channels*sizeof(short)) {
+		munmap(map, size);
+		return false;
+	}
+	asset.samples = (const short*)(header+1);
+	asset.frames = header->frames;
+	asset.channels = header->channels;
+	asset.rate = header->rate;
+	asset.map = map;
+	asset.map_size = size;
+	// played from start to end, over and over for music
+	madvise(map, size, MADV_WILLNEED);
+	return true;
+}
+
+bool pcmCacheLoad (const char* source, PCMAsset& asset)
+{
+	unsigned long long hash;
+	if (!hashFile(source, hash)) {
+		fprintf(stderr, "Cannot read %s\n", source);
+		return false;
+	}
+	char path[512];
+	snprintf(path, sizeof path, "%s/%016llx.pcm", PCM_CACHE_DIR, hash);
+	if (mapCached(path, asset))
+		return true;
+
+	mkdir(PCM_CACHE_DIR, 0755);
+	return decodeToCache(source, path) && mapCached(path, asset);
+}
+
+void pcmCacheRelease (PCMAsset& asset)
+{
+	if (asset.map)
+		munmap(asset.map, asset.map_size);
+	asset.map = NULL;
+	asset.samples = NULL;
+	asset.frames = 0;
+}
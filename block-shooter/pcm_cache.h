@@ -0,0 +1,37 @@
+#ifndef PCM_CACHE_H
+#define PCM_CACHE_H
+
+#include <cstddef>
+
+/* Decode-once cache of sound assets. The first load of an MP3 decodes it
+   to signed 16-bit PCM in PCM_CACHE_DIR, named after a hash of the MP3's
+   bytes; every later load just memory-maps that file, so startup does no
+   decoding and playback reads samples straight from the page cache.
+   Editing the MP3 changes its hash, so stale entries are never used.
+   Music and short sound effects go through the same cache.
+
+   Cache file layout:
+     "BSPC", u32 PCM_CACHE_VERSION, u32 rate, u32 channels, u64 frames,
+     then frames*channels interleaved int16 samples. */
+
+#define PCM_CACHE_DIR "pcm_cache"
+#define PCM_CACHE_VERSION 1
+
+struct PCMAsset {
+	const short* samples;  // interleaved, inside the mapping
+	size_t frames;
+	int channels;
+	long rate;
+
+	void* map;             // whole cache file, for munmap
+	size_t map_size;
+};
+
+/* Map the decoded form of 'source', decoding it into the cache first if
+   needed. Needs mpg123_init(). False (with a message) on any failure */
+bool pcmCacheLoad (const char* source, PCMAsset& asset);
+
+/* Unmap an asset returned by pcmCacheLoad */
+void pcmCacheRelease (PCMAsset& asset);
+
+#endif
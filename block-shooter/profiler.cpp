@@ -0,0 +1,119 @@
+#include <cstdio>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include "profiler.h"
+#include "spsc_queue.h"
+
+using namespace std;
+
+const char* profilePhaseName[PROF_PHASES] = {
+	"frame", "sim_step", "move", "mirrors", "buckets", "collide", "spawn", "particles",
+	"draw_scene", "draw_blocks", "draw_bullets", "draw_particles", "draw_flush", "draw_hud", "swap", "gpu", "input"
+};
+
+std::atomic<bool> profile_enabled(false);
+ProfileStats profileStats[PROF_PHASES];
+
+static vector<unsigned long long> samples[PROF_PHASES];
+static unsigned long long window_start = 0, profile_origin = 0;
+static FILE* csv_file = NULL;
+
+// samples from the other thread, waiting for the next profileTick()
+#define PROFILE_REMOTE_QUEUE 4096
+struct RemoteSample {
+	int phase;
+	unsigned long long ns;
+};
+static SPSCQueue<RemoteSample> remote;
+static struct RemoteInit { RemoteInit () { remote.init(PROFILE_REMOTE_QUEUE); } } remote_init;
+static pthread_t owner = pthread_self(); // statics are set up on the main thread
+
+unsigned long long profileNow ()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+void profileSample (int phase, unsigned long long ns)
+{
+	if (pthread_equal(pthread_self(), owner))
+		samples[phase].push_back(ns);
+	else {
+		RemoteSample s = { phase, ns };
+		remote.push(s); // a full queue drops the sample
+	}
+}
+
+bool profileOpenCSV (const char* path)
+{
+	csv_file = fopen(path, "w");
+	if (csv_file == NULL) {
+		fprintf(stderr, "Cannot write profile to %s\n", path);
+		return false;
+	}
+	fprintf(csv_file, "time_s,phase,count,min_us,avg_us,p99_us,max_us\n");
+	return true;
+}
+
+/* Reduce one phase's samples; the vector is reordered */
+static ProfileStats reduce (vector<unsigned long long>& s)
+{
+	ProfileStats r = { (int)s.size(), 0, 0, 0, 0 };
+	if (s.empty())
+		return r;
+	unsigned long long lo = s[0], hi = s[0], sum = 0;
+	for (size_t i=0; i<s.size(); i++) {
+		lo = min(lo, s[i]);
+		hi = max(hi, s[i]);
+		sum += s[i];
+	}
+	// nearest-rank 99th percentile
+	size_t k = (s.size()*99 + 99)/100 - 1;
+	nth_element(s.begin(), s.begin()+k, s.end());
+	r.min = lo/1000.0;
+	r.avg = sum/1000.0/s.size();
+	r.p99 = s[k]/1000.0;
+	r.max = hi/1000.0;
+	return r;
+}
+
+void profileTick ()
+{
+	RemoteSample s;
+	if (!profile_enabled) {
+		// whatever came in meanwhile belongs to no window : drop it, and
+		// start a fresh window once profiling is back on
+		while (remote.pop(s))
+			;
+		for (int p=0; p<PROF_PHASES; p++)
+			samples[p].clear();
+		window_start = 0;
+		return;
+	}
+	while (remote.pop(s))
+		samples[s.phase].push_back(s.ns);
+	unsigned long long now = profileNow();
+	if (window_start == 0) {
+		window_start = now;
+		if (profile_origin == 0)
+			profile_origin = now;
+		return;
+	}
+	if (now - window_start < 1000000000ULL)
+		return;
+
+	double at = (now - profile_origin)/1e9;
+	for (int p=0; p<PROF_PHASES; p++) {
+		profileStats[p] = reduce(samples[p]);
+		samples[p].clear();
+		ProfileStats& s = profileStats[p];
+		if (csv_file && s.count)
+			fprintf(csv_file, "%.3f,%s,%d,%.2f,%.2f,%.2f,%.2f\n", at, profilePhaseName[p], s.count, s.min, s.avg, s.p99, s.max);
+	}
+	if (csv_file)
+		fflush(csv_file);
+	window_start = now;
+}
@@ -0,0 +1,79 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Per-phase CPU timing (plus GPU time fed in from GL timer queries).
+   Every timed interval is one sample of its phase. Once per second the
+   samples of each phase are reduced to min/avg/p99/max, kept in
+   profileStats for the overlay and appended to the CSV file if one is
+   open. Timing is off until profile_enabled is set, and then costs two
+   clock reads per interval. Samples normally come from the thread that
+   calls profileTick(); one other thread (the simulation's) may add some
+   too, which reach the owner through a lock-free queue. */
+
+#include <atomic>
+
+enum ProfilePhase {
+	PROF_FRAME,        // draw() to draw(), what the player sees
+	PROF_SIM_STEP,     // one whole simulate()
+	PROF_MOVE,         // block and bullet integration
+	PROF_MIRRORS,      // mirror reflection
+	PROF_BUCKETS,      // bucket scoring
+	PROF_COLLIDE,      // bullet vs block
+	PROF_SPAWN,        // block spawning
+	PROF_PARTICLES,    // particle step, after the simulation step
+	PROF_DRAW_SCENE,   // queueing mirrors and buckets
+	PROF_DRAW_BLOCKS,  // filling the instanced block batch
+	PROF_DRAW_BULLETS, // queueing gun and bullets
+	PROF_DRAW_PARTICLES, // uploading the particle image's changed rows, one quad
+	PROF_DRAW_FLUSH,   // sorting the render queue and issuing it to GL
+	PROF_DRAW_HUD,     // HUD text, laid out again only when it changes
+	PROF_SWAP,         // glutSwapBuffers
+	PROF_GPU,          // GPU time of the whole draw submission
+	PROF_INPUT,        // input event to the first frame showing its effect
+	PROF_PHASES
+};
+
+extern const char* profilePhaseName[PROF_PHASES];
+
+struct ProfileStats {
+	int count;                   // samples in the window
+	double min, avg, p99, max;   // microseconds
+};
+
+extern std::atomic<bool> profile_enabled;
+extern ProfileStats profileStats[PROF_PHASES]; // last completed window
+
+/* Monotonic clock in nanoseconds */
+unsigned long long profileNow ();
+
+/* Add a measured interval to a phase, from either thread */
+void profileSample (int phase, unsigned long long ns);
+
+/* Stream every completed window to 'path' as CSV */
+bool profileOpenCSV (const char* path);
+
+/* Call once per frame (or tick); closes the window after one second */
+void profileTick ();
+
+/* Times the current phase from construction; lap() closes it and starts
+   the next one, so consecutive sections need no extra nesting */
+struct ProfileTimer {
+	int phase;
+	unsigned long long start;
+
+	ProfileTimer (int first) : phase(first), start(profile_enabled ? profileNow() : 0) {}
+	~ProfileTimer () { lap(-1); }
+
+	void lap (int next)
+	{
+		if (!profile_enabled)
+			return;
+		unsigned long long now = profileNow();
+		if (phase >= 0 && start)
+			profileSample(phase, now - start);
+		phase = next;
+		start = now;
+	}
+};
+
+#endif
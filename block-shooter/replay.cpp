@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cstring>
+#include "game.h"
+#include "replay.h"
+
+using namespace std;
+
+static FILE* record_file = NULL;
+static int record_tick = 0; // tick of the last event written
+
+static void putByte (FILE* f, unsigned int v)
+{
+	fputc(v & 0xFF, f);
+}
+
+static void putU32 (FILE* f, unsigned int v)
+{
+	for (int i=0; i<4; i++)
+		putByte(f, v >> (8*i));
+}
+
+static void putVarint (FILE* f, unsigned int v)
+{
+	while (v >= 0x80) {
+		putByte(f, v | 0x80);
+		v >>= 7;
+	}
+	putByte(f, v);
+}
+
+static void putFloat (FILE* f, float v)
+{
+	unsigned int bits;
+	memcpy(&bits, &v, sizeof bits);
+	putU32(f, bits);
+}
+
+bool startRecording (const char* path, unsigned int seed)
+{
+	record_file = fopen(path, "wb");
+	if (record_file == NULL) {
+		fprintf(stderr, "Cannot record to %s\n", path);
+		return false;
+	}
+	fwrite("BSRP", 1, 4, record_file);
+	putByte(record_file, REPLAY_VERSION);
+	putU32(record_file, seed);
+	putByte(record_file, SIM_HZ);
+	putByte(record_file, SIM_HZ >> 8);
+	putU32(record_file, levelHash);
+	putU32(record_file, levelHash >> 32);
+	record_tick = 0;
+	return true;
+}
+
+void recordAction (int tick, int action, float value)
+{
+	if (record_file == NULL)
+		return;
+	putVarint(record_file, tick - record_tick);
+	putByte(record_file, action);
+	if (action != ACT_FIRE)
+		putFloat(record_file, value);
+	record_tick = tick;
+}
+
+void stopRecording (int tick, unsigned long long hash)
+{
+	if (record_file == NULL)
+		return;
+	putVarint(record_file, tick - record_tick);
+	putByte(record_file, REPLAY_END);
+	putU32(record_file, hash);
+	putU32(record_file, hash >> 32);
+	fclose(record_file);
+	record_file = NULL;
+}
+
+/* Reader side : every get* sets 'ok' to false at end of file */
+static unsigned int getByte (FILE* f, bool& ok)
+{
+	int c = fgetc(f);
+	if (c == EOF)
+		ok = false;
+	return c & 0xFF;
+}
+
+static unsigned int getU32 (FILE* f, bool& ok)
+{
+	unsigned int v = 0;
+	for (int i=0; i<4; i++)
+		v |= getByte(f, ok) << (8*i);
+	return v;
+}
+
+static unsigned int getVarint (FILE* f, bool& ok)
+{
+	unsigned int v = 0;
+	for (int shift=0; shift<35 && ok; shift+=7) {
+		unsigned int b = getByte(f, ok);
+		v |= (b & 0x7F) << shift;
+		if (!(b & 0x80))
+			break;
+	}
+	return v;
+}
+
+bool loadReplay (const char* path, Replay& replay)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open replay %s\n", path);
+		return false;
+	}
+	bool ok = true;
+	char magic[4];
+	if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "BSRP", 4) || getByte(f, ok) != REPLAY_VERSION) {
+		fprintf(stderr, "%s is not a version %d replay\n", path, REPLAY_VERSION);
+		fclose(f);
+		return false;
+	}
+	replay.seed = getU32(f, ok);
+	unsigned int hz = getByte(f, ok);
+	hz |= getByte(f, ok) << 8;
+	if (ok && hz != SIM_HZ) {
+		fprintf(stderr, "%s was recorded at %u Hz, this build steps at %d Hz\n", path, hz, SIM_HZ);
+		fclose(f);
+		return false;
+	}
+	replay.levelHash = getU32(f, ok);
+	replay.levelHash |= (unsigned long long)getU32(f, ok) << 32;
+	replay.events.clear();
+	replay.endTick = -1;
+	replay.endHash = 0;
+
+	int tick = 0;
+	while (ok) {
+		unsigned int delta = getVarint(f, ok);
+		unsigned int action = getByte(f, ok);
+		if (!ok)
+			break;
+		tick += delta;
+		if (action == REPLAY_END) {
+			unsigned long long lo = getU32(f, ok);
+			unsigned long long hi = getU32(f, ok);
+			if (ok) {
+				replay.endTick = tick;
+				replay.endHash = lo | (hi << 32);
+			}
+			break;
+		}
+		if (action >= ACT_COUNT) {
+			fprintf(stderr, "%s: unknown action %u at tick %d\n", path, action, tick);
+			fclose(f);
+			return false;
+		}
+		ReplayEvent e;
+		e.tick = tick;
+		e.action = action;
+		e.value = 0;
+		if (action != ACT_FIRE) {
+			unsigned int bits = getU32(f, ok);
+			memcpy(&e.value, &bits, sizeof bits);
+		}
+		if (ok)
+			replay.events.push_back(e);
+	}
+	fclose(f);
+	if (replay.endTick < 0)
+		fprintf(stderr, "%s: recording has no end marker, replaying %d events\n", path, (int)replay.events.size());
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <vector>
+
+/* Session recording : the game seed plus every player action stamped with
+   the simulation tick it was applied at. Applying the same actions at the
+   same ticks from the same seed reproduces the session bit for bit, at any
+   speed, so recordings double as performance traces.
+
+   File layout (integers little endian):
+     header  "BSRP", u8 version, u32 seed, u16 SIM_HZ, u64 levelHash
+     event   varint tick delta, u8 GameAction, f32 value (absent for ACT_FIRE)
+     end     varint tick delta, u8 REPLAY_END, u64 stateHash() at that tick
+   Tick deltas are LEB128 varints, so a typical event takes 2 or 6 bytes. */
+
+#define REPLAY_VERSION 7 // 2 : cached bullet velocities, 3 : segment mirrors, 4 : levels, 5 : catch lines, 6 : full state hash, 7 : no hits off the playfield
+#define REPLAY_END 0xFF
+
+struct ReplayEvent {
+	int tick;
+	int action;
+	float value;
+};
+
+struct Replay {
+	unsigned int seed;
+	unsigned long long levelHash; // of the level played, 0 for the built-in one
+	std::vector<ReplayEvent> events;
+	int endTick;                 // -1 if the recording has no end marker
+	unsigned long long endHash;
+};
+
+/* Start logging to 'path'; false if the file cannot be created */
+bool startRecording (const char* path, unsigned int seed);
+/* Log one action; does nothing unless a recording is running */
+void recordAction (int tick, int action, float value);
+/* Write the end marker and close the log */
+void stopRecording (int tick, unsigned long long hash);
+
+/* Read a whole recording; false (with a message) if it is malformed */
+bool loadReplay (const char* path, Replay& replay);
+
+#endif
@@ -0,0 +1,195 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "shader_cache.h"
+#include "files.h"
+
+using namespace std;
+
+int shader_cache_hits = 0, shader_cache_misses = 0;
+
+struct ShaderCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int format;
+	unsigned int length;
+};
+
+/* Continue 'hash' over 'text' and its terminating NUL, so that moving
+   bytes from one string to the next changes the hash */
+static void hashString (unsigned long long& hash, const char* text)
+{
+	hash = fnv1a(text, strlen(text)+1, hash);
+}
+
+static bool binarySupported ()
+{
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+/* Print a shader's or program's info log if it has anything to say */
+static void printLog (GLuint object, bool program, const char* what)
+{
+	GLint length = 0;
+	if (program)
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+	else
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1)
+		return;
+	vector<char> log(length);
+	if (program)
+		glGetProgramInfoLog(object, length, NULL, &log[0]);
+	else
+		glGetShaderInfoLog(object, length, NULL, &log[0]);
+	fprintf(stderr, "%s:\n%s\n", what, &log[0]);
+}
+
+static GLuint compileShader (GLenum type, const string& source)
+{
+	GLuint shader = glCreateShader(type);
+	const char* text = source.c_str();
+	glShaderSource(shader, 1, &text, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+/* Create a program from a cache file; 0 if there is none or the driver
+   does not take it */
+static GLuint loadCached (const char* path)
+{
+	string data;
+	if (!readText(path, data))
+		return 0;
+	const ShaderCacheHeader* header = (const ShaderCacheHeader*)data.data();
+	if (data.size() < sizeof *header || memcmp(header->magic, "BSSH", 4) || header->version != SHADER_CACHE_VERSION
+			|| data.size() != sizeof *header + header->length)
+		return 0;
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header->format, header+1, header->length);
+	GLint ok = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+/* Store a linked program's binary */
+static void storeCached (GLuint program, const char* path)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	vector<char> binary(length);
+	GLenum format;
+	glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, "BSSH", 4);
+	header.version = SHADER_CACHE_VERSION;
+	header.format = format;
+	header.length = length;
+
+	mkdir(SHADER_CACHE_DIR, 0755);
+	AtomicFile file;
+	if (!atomicOpen(file, path))
+		return;
+	fwrite(&header, sizeof header, 1, file.f);
+	fwrite(&binary[0], 1, length, file.f);
+	if (!atomicCommit(file))
+		fprintf(stderr, "Cannot cache %s\n", path);
+}
+
+void shaderBuildStart (ShaderBuild& build, const char* vertex_file_path, const char* fragment_file_path)
+{
+	string vertex, fragment;
+	if (!readText(vertex_file_path, vertex))
+		fprintf(stderr, "Cannot read %s\n", vertex_file_path);
+	if (!readText(fragment_file_path, fragment))
+		fprintf(stderr, "Cannot read %s\n", fragment_file_path);
+	build.name = string(vertex_file_path) + " + " + fragment_file_path;
+	build.vertex = build.fragment = 0;
+
+	build.cacheable = binarySupported();
+	if (build.cacheable) {
+		unsigned long long hash = FNV_OFFSET;
+		hashString(hash, vertex.c_str());
+		hashString(hash, fragment.c_str());
+		hashString(hash, (const char*)glGetString(GL_VENDOR));
+		hashString(hash, (const char*)glGetString(GL_RENDERER));
+		hashString(hash, (const char*)glGetString(GL_VERSION));
+		snprintf(build.cache_path, sizeof build.cache_path, "%s/%016llx.bin", SHADER_CACHE_DIR, hash);
+		build.program = loadCached(build.cache_path);
+		if (build.program) {
+			shader_cache_hits++;
+			return;
+		}
+	}
+	shader_cache_misses++;
+
+	// with parallel compiling none of these wait for the compiler
+	build.vertex = compileShader(GL_VERTEX_SHADER, vertex);
+	build.fragment = compileShader(GL_FRAGMENT_SHADER, fragment);
+	build.program = glCreateProgram();
+	glAttachShader(build.program, build.vertex);
+	glAttachShader(build.program, build.fragment);
+	if (build.cacheable)
+		glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(build.program);
+}
+
+bool shaderBuildReady (const ShaderBuild& build)
+{
+	if (build.vertex == 0 || !(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile))
+		return true;
+	GLint done = GL_TRUE;
+	glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done;
+}
+
+GLuint shaderBuildFinish (ShaderBuild& build)
+{
+	GLuint program = build.program;
+	build.program = 0;
+	if (build.vertex == 0)
+		return program; // from the cache, linked already
+
+	GLint ok = GL_FALSE;
+	GLuint shaders[2] = { build.vertex, build.fragment };
+	for (int i=0; i<2; i++) {
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &ok);
+		printLog(shaders[i], false, build.name.c_str());
+		if (!ok)
+			fprintf(stderr, "Cannot compile the %s shader of %s\n", i ? "fragment" : "vertex", build.name.c_str());
+		glDetachShader(program, shaders[i]);
+		glDeleteShader(shaders[i]);
+	}
+	build.vertex = build.fragment = 0;
+
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	printLog(program, true, build.name.c_str());
+	if (!ok) {
+		fprintf(stderr, "Cannot link %s\n", build.name.c_str());
+		glDeleteProgram(program);
+		return 0;
+	}
+	if (build.cacheable)
+		storeCached(program, build.cache_path);
+	return program;
+}
+
+GLuint LoadShaders (const char* vertex_file_path, const char* fragment_file_path)
+{
+	ShaderBuild build;
+	shaderBuildStart(build, vertex_file_path, fragment_file_path);
+	return shaderBuildFinish(build);
+}
@@ -0,0 +1,52 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <string>
+#include <GL/glew.h>
+
+/* Linked shader programs cached as driver binaries. The first load of a
+   vertex + fragment shader pair compiles and links them, then stores the
+   program's glGetProgramBinary() output in SHADER_CACHE_DIR, named after a
+   hash of both sources and of GL_VENDOR, GL_RENDERER and GL_VERSION; later
+   loads hand that file to glProgramBinary() and skip the compiler. A new
+   driver or an edited shader changes the hash, and a binary the driver
+   rejects anyway is recompiled and replaced. Without program binary
+   support (GL 4.1 / ARB_get_program_binary) every load compiles.
+
+   Cache file layout:
+     "BSSH", u32 SHADER_CACHE_VERSION, u32 binary format, u32 length,
+     then length bytes of program binary. */
+
+#define SHADER_CACHE_DIR "shader_cache"
+#define SHADER_CACHE_VERSION 1
+
+/* Load, or compile and link, the program made of the two shader files.
+   Needs a current GL context and glewInit(). Compile and link errors are
+   printed with the file they came from, and give 0 */
+GLuint LoadShaders (const char* vertex_file_path, const char* fragment_file_path);
+
+/* The same in steps, for rebuilding programs while the game runs. With
+   KHR_parallel_shader_compile the driver compiles and links on its own
+   threads and shaderBuildReady() polls it without blocking; otherwise
+   the work happens in shaderBuildStart() or shaderBuildFinish() */
+struct ShaderBuild {
+	GLuint program;            // 0 when no build is running
+	GLuint vertex, fragment;   // 0 when the program came from the cache
+	bool cacheable;
+	char cache_path[512];
+	std::string name;          // "x.vert + y.frag", for messages
+};
+
+void shaderBuildStart (ShaderBuild& build, const char* vertex_file_path, const char* fragment_file_path);
+
+/* True once shaderBuildFinish() would not wait for the driver */
+bool shaderBuildReady (const ShaderBuild& build);
+
+/* The linked program, stored in the cache, or 0 (with the logs printed)
+   if it does not compile or link. Ends the build either way */
+GLuint shaderBuildFinish (ShaderBuild& build);
+
+/* Programs loaded from the cache and compiled since startup */
+extern int shader_cache_hits, shader_cache_misses;
+
+#endif
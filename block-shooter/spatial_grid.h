@@ -0,0 +1,102 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <vector>
+#include <cmath>
+
+/* Uniform grid over the fixed ortho playfield (-4..4 on both axes) used as
+   the broad phase for bullet-vs-block tests.
+   Blocks are bucketed by centre with a counting sort every tick: cellStart
+   holds, for each cell, the first slot of its blocks in 'items' (CSR
+   layout), so a rebuild is two linear passes and no allocation once the
+   vectors have grown. Points just outside the playfield are clamped to
+   the border cells; clamping never moves two points further apart, so the
+   3x3 neighbourhood query below stays exact for them too. Points further
+   out than GRID_MARGIN are left out of the grid altogether : blocks that
+   fell past the buckets keep falling until the pools retire them, and
+   clamped into the bottom row they would pile up under every query
+   there. Nothing out there is on screen to be shot at. */
+
+#define GRID_MIN  -4.0f
+#define GRID_CELL 0.25f  // must be >= the collision half-width (0.2)
+#define GRID_DIM  32     // (4 - -4) / GRID_CELL
+#define GRID_MARGIN 1.0f // how far outside the playfield points still go in
+
+struct SpatialGrid {
+	std::vector<int> cellStart; // GRID_DIM*GRID_DIM+1 offsets into items
+	std::vector<int> items;     // block indices ordered by cell
+	std::vector<int> cellOf;    // cell of every block, scratch for the build
+};
+
+/* Column or row of coordinate v, clamped into the grid */
+inline int gridCoord (float v)
+{
+	int c = (int)floorf((v - GRID_MIN) / GRID_CELL);
+	return c < 0 ? 0 : (c >= GRID_DIM ? GRID_DIM-1 : c);
+}
+
+/* True if (x, y) is close enough to the playfield to be in the grid */
+inline bool inGrid (float x, float y)
+{
+	const float lo = GRID_MIN-GRID_MARGIN, hi = GRID_MIN+GRID_DIM*GRID_CELL+GRID_MARGIN;
+	return x >= lo && x <= hi && y >= lo && y <= hi;
+}
+
+/* Rebucket 'count' points; call whenever the points have moved */
+inline void buildGrid (SpatialGrid& grid, const float* x, const float* y, int count)
+{
+	grid.cellStart.assign(GRID_DIM*GRID_DIM+1, 0);
+	grid.items.resize(count);
+	grid.cellOf.resize(count);
+
+	int i,c;
+	for(i=0;i<count;i++)
+	{
+		if(!inGrid(x[i], y[i]))
+		{
+			grid.cellOf[i] = -1;
+			continue;
+		}
+		int cell = gridCoord(y[i])*GRID_DIM + gridCoord(x[i]);
+		grid.cellOf[i] = cell;
+		grid.cellStart[cell+1]++;
+	}
+	for(c=0;c<GRID_DIM*GRID_DIM;c++)
+		grid.cellStart[c+1] += grid.cellStart[c];
+
+	// cellStart[c] is used as the write cursor of cell c and ends up at
+	// the start of cell c+1, so shift it back afterwards
+	for(i=0;i<count;i++)
+		if(grid.cellOf[i] >= 0)
+			grid.items[grid.cellStart[grid.cellOf[i]]++] = i;
+	for(c=GRID_DIM*GRID_DIM;c>0;c--)
+		grid.cellStart[c] = grid.cellStart[c-1];
+	grid.cellStart[0] = 0;
+}
+
+/* First point within 'range' of (cx, cy) on both axes that is not marked
+   in 'dead', or -1. Only the 3x3 cells around (cx, cy) are visited */
+inline int queryGrid (const SpatialGrid& grid, const float* x, const float* y, const std::vector<char>& dead, float cx, float cy, float range)
+{
+	int gx = gridCoord(cx), gy = gridCoord(cy);
+	int x0 = gx > 0 ? gx-1 : 0, x1 = gx < GRID_DIM-1 ? gx+1 : GRID_DIM-1;
+	int y0 = gy > 0 ? gy-1 : 0, y1 = gy < GRID_DIM-1 ? gy+1 : GRID_DIM-1;
+
+	int row,col,k;
+	for(row=y0;row<=y1;row++)
+	{
+		for(col=x0;col<=x1;col++)
+		{
+			int cell = row*GRID_DIM + col;
+			for(k=grid.cellStart[cell];k<grid.cellStart[cell+1];k++)
+			{
+				int j = grid.items[k];
+				if(!dead[j] && fabsf(x[j]-cx) <= range && fabsf(y[j]-cy) <= range)
+					return j;
+			}
+		}
+	}
+	return -1;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+/* Lock-free single-producer single-consumer ring of T.
+   Exactly one thread may push and exactly one other thread may pop.
+   head and tail are free-running counters (never wrapped), each written
+   only by its owner; the capacity is a power of two so a counter maps to a
+   slot with a mask. The counters sit on separate cache lines so the two
+   threads do not false-share. */
+template <class T>
+class SPSCQueue {
+public:
+	SPSCQueue () : mask(0), head(0), tail(0) {}
+
+	/* Size the ring for at least 'capacity' items; not thread safe */
+	void init (size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+		buffer.assign(size, T());
+		mask = size - 1;
+		head.store(0);
+		tail.store(0);
+	}
+
+	size_t capacity () const { return buffer.size(); }
+
+	/* Items ready to pop; exact for the consumer, a lower bound otherwise */
+	size_t size () const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+	/* Producer : append up to n items, returns how many fitted */
+	size_t push (const T* items, size_t n)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t free = buffer.size() - (h - tail.load(std::memory_order_acquire));
+		if (n > free)
+			n = free;
+		for (size_t i=0; i<n; i++)
+			buffer[(h+i) & mask] = items[i];
+		head.store(h+n, std::memory_order_release);
+		return n;
+	}
+
+	bool push (const T& item) { return push(&item, 1) == 1; }
+
+	/* Consumer : remove up to n items, returns how many were taken */
+	size_t pop (T* items, size_t n)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t ready = head.load(std::memory_order_acquire) - t;
+		if (n > ready)
+			n = ready;
+		for (size_t i=0; i<n; i++)
+			items[i] = buffer[(t+i) & mask];
+		tail.store(t+n, std::memory_order_release);
+		return n;
+	}
+
+	bool pop (T& item) { return pop(&item, 1) == 1; }
+
+private:
+	std::vector<T> buffer;
+	size_t mask;
+	alignas(64) std::atomic<size_t> head; // written by the producer
+	alignas(64) std::atomic<size_t> tail; // written by the consumer
+};
+
+#endif
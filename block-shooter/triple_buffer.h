@@ -0,0 +1,54 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/* Lock-free triple buffer handing whole values of T from one writer
+   thread to one reader thread. The writer fills its back slot and
+   publishes it; the reader switches to the latest published slot when it
+   likes. Each side swaps its slot with the middle one in one atomic
+   exchange, so neither ever waits for the other, the writer never
+   touches what the reader holds, and values published faster than the
+   reader takes them are skipped. Slots are reused, so T can keep its
+   storage from one value to the next. */
+template <class T>
+class TripleBuffer {
+public:
+	TripleBuffer () : back(0), front(2), middle(1) {}
+
+	/* Writer : the slot to fill before the next publish() */
+	T& writing () { return slots[back]; }
+
+	/* Writer : hand the filled slot over. Returns true if the slot the
+	   writer gets back instead was published earlier but never taken */
+	bool publish ()
+	{
+		int old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+		back = old & ~FRESH;
+		return old & FRESH;
+	}
+
+	/* Reader : true if a value was published since the last update() */
+	bool fresh () const { return middle.load(std::memory_order_relaxed) & FRESH; }
+
+	/* Reader : switch to the latest published value, if there is a new
+	   one; returns whether there was */
+	bool update ()
+	{
+		if (!fresh())
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+		return true;
+	}
+
+	/* Reader : the value taken by the last update() */
+	T& reading () { return slots[front]; }
+
+private:
+	enum { FRESH = 4 };        // set in 'middle' until the reader takes it
+	T slots[3];
+	int back, front;           // owned by the writer and the reader
+	alignas(64) std::atomic<int> middle;
+};
+
+#endif